@@ -31,6 +31,10 @@ struct {
   // Sorted by how recently the buffer was used.
   // head.next is most recent, head.prev is least.
   struct buf head;
+
+  uint64 hits;     // bget()s that found the block cached
+  uint64 misses;   // and that didn't; lock protects these
+  uint64 writes;   // bwrite()s; atomic
 } bcache;
 
 void
@@ -66,6 +70,7 @@ bget(uint dev, uint blockno)
   for(b = bcache.head.next; b != &bcache.head; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
+      bcache.hits++;
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
@@ -80,6 +85,7 @@ bget(uint dev, uint blockno)
       b->blockno = blockno;
       b->valid = 0;
       b->refcnt = 1;
+      bcache.misses++;
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
@@ -108,6 +114,7 @@ bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
+  __sync_fetch_and_add(&bcache.writes, 1);
   virtio_disk_rw(b, 1);
 }
 
@@ -136,6 +143,32 @@ brelse(struct buf *b)
   release(&bcache.lock);
 }
 
+// Release a locked buffer that is unlikely to be used again,
+// such as a file data block copied into the page cache.
+// Move it to the least-recently-used end, so it is recycled
+// before metadata blocks.
+void
+brelsecold(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("brelsecold");
+
+  releasesleep(&b->lock);
+
+  acquire(&bcache.lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    b->next->prev = b->prev;
+    b->prev->next = b->next;
+    b->prev = bcache.head.prev;
+    b->next = &bcache.head;
+    bcache.head.prev->next = b;
+    bcache.head.prev = b;
+  }
+  
+  release(&bcache.lock);
+}
+
 void
 bpin(struct buf *b) {
   acquire(&bcache.lock);
@@ -150,4 +183,19 @@ bunpin(struct buf *b) {
   release(&bcache.lock);
 }
 
+// Describe the buffer cache, for /proc/bcache.
+int
+bcacheprint(char *buf, int sz)
+{
+  struct buf *b;
+  int inuse = 0, n;
 
+  acquire(&bcache.lock);
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++)
+    if(b->refcnt)
+      inuse++;
+  n = snprintf(buf, sz, "buffers %d\ninuse %d\nhits %ld\nmisses %ld\nwrites %ld\n",
+               NBUF, inuse, bcache.hits, bcache.misses, bcache.writes);
+  release(&bcache.lock);
+  return n;
+}
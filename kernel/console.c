@@ -21,23 +21,27 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "poll.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
 
 //
 // send one character to the uart.
-// called by printf(), and to echo input characters,
+// called to echo input characters, from interrupts,
 // but not from write().
 //
 void
 consputc(int c)
 {
+  char ch;
+
   if(c == BACKSPACE){
     // if the user typed backspace, overwrite with a space.
-    uartputc_sync('\b'); uartputc_sync(' '); uartputc_sync('\b');
+    uartputs_kernel("\b \b", 3);
   } else {
-    uartputc_sync(c);
+    ch = c;
+    uartputs_kernel(&ch, 1);
   }
 }
 
@@ -53,18 +57,22 @@ struct {
 } cons;
 
 //
-// user write()s to the console go here.
+// user write()s to the console go here, a
+// chunk at a time.
 //
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
-
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  char buf[128];
+  int i, m;
+
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    uartputc(c);
+    uartputs(buf, m);
   }
 
   return i;
@@ -83,6 +91,15 @@ consoleread(int user_dst, uint64 dst, int n)
   int c;
   char cbuf;
 
+  // either_copyout() can't fault with cons.lock held, so fault
+  // in first: at most a buffer's worth, as a line is usually
+  // shorter; a longer one is returned in pieces.
+  if(user_dst){
+    if(n > INPUT_BUF_SIZE)
+      n = INPUT_BUF_SIZE;
+    if(n > 0 && (n = uvmprefault(dst, n, 1)) == 0)
+      return -1;
+  }
   target = n;
   acquire(&cons.lock);
   while(n > 0){
@@ -126,6 +143,22 @@ consoleread(int user_dst, uint64 dst, int n)
   return target - n;
 }
 
+//
+// a read won't block once a line has arrived,
+// nor a write while the uart's buffer has room.
+//
+int
+consolepoll(int minor)
+{
+  int r = uartwritable() ? POLLOUT : 0;
+
+  acquire(&cons.lock);
+  if(cons.r != cons.w)
+    r |= POLLIN;
+  release(&cons.lock);
+  return r;
+}
+
 //
 // the console input interrupt handler.
 // uartintr() calls this for input character.
@@ -170,6 +203,7 @@ consoleintr(int c)
         // has arrived.
         cons.w = cons.e;
         wakeup(&cons.r);
+        pollwakeup();
       }
     }
     break;
@@ -189,4 +223,5 @@ consoleinit(void)
   // to consoleread and consolewrite.
   devsw[CONSOLE].read = consoleread;
   devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].poll = consolepoll;
 }
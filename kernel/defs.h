@@ -1,18 +1,24 @@
 struct buf;
 struct context;
+struct fastret;
 struct file;
 struct inode;
+struct kmem_cache;
+struct page;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct sysstat;
 
 // bio.c
 void            binit(void);
+int             bcacheprint(char*, int);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
+void            brelsecold(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
@@ -24,15 +30,20 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execfault(struct proc*, uint64, int);
 
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
+struct file*    fdfile(int);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             fileprint(int, struct file**, char*, int);
+int             filepoll(struct file*);
+int             filefcntl(struct file*, int, int);
 
 // fs.c
 void            fsinit(int);
@@ -50,9 +61,11 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+int             readblocks(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
+uint            bmap(struct inode*, uint);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -61,37 +74,91 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_zeroed(void);
+int             kzeroidle(void);
 void            kfree(void *);
 void            kinit(void);
+void            krefinc(void *);
+int             krefcount(void *);
+uint64          kfreepages(void);
+int             kmemprint(char*, int);
+
+// klog.c
+void            klogwrite(char*, int, int);
+void            klogdrain(void);
+void            klogflush_sync(void);
+int             dmesg(uint64, int);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+int             logprint(char*, int);
+
+// mmap.c
+uint64          mmap(uint64, int, int, struct file*, uint);
+int             munmap(uint64, uint64);
+int             mmapfault(struct proc*, uint64, int);
+int             mmapfork(struct proc*, struct proc*);
+void            mmapexit(struct proc*);
+
+// pagecache.c
+void            pcinit(void);
+struct page*    pcget(struct inode*, uint);
+struct page*    pcfind(struct inode*, uint);
+void            pcput(struct page*);
+int             pcread(struct inode*, int, uint64, uint, uint);
+void            pcupdate(struct inode*, uint, char*, uint);
+void            pcinval(struct inode*);
+int             pcshrink(void);
+int             pcprint(char*, int);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, uint64, int, int);
+int             pipewrite(struct pipe*, uint64, int, int);
+int             pipepoll(struct pipe*);
+
+// poll.c
+void            pollinit(void);
+void            pollwakeup(void);
+int             poll(uint64, int, int);
 
 // printf.c
 int            printf(char*, ...) __attribute__ ((format (printf, 1, 2)));
 void            panic(char*) __attribute__((noreturn));
-void            printfinit(void);
+
+// procfs.c
+void            procfsinit(void);
+
+// prof.c
+void            profinit(void);
+void            profsample(uint64, int);
+int             profctl(int);
+int             profread(uint64, int);
 
 // proc.c
 int             cpuid(void);
+int             procsysstat(int, struct sysstat*, int);
+int             getcounters(uint64);
 void            exit(int);
 int             fork(void);
+int             clone(uint64, uint64, uint64);
+int             join(int, uint64);
+void            killthreads(struct proc*);
+int             futex(uint64, int, int);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
+struct proc*    findproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
+int             setpriority(int, int, int);
+int             nice(int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -102,10 +169,13 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+int             procprint(char*, int);
+int             procfilesprint(char*, int);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -117,6 +187,36 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             statslock(char*, int);
+void            statslockreset(void);
+
+// shm.c
+void            shminit(void);
+int             shmget(int, int);
+uint64          shmat(int);
+int             shmdt(uint64);
+int             shmrm(int);
+int             shmfork(struct proc*, struct proc*);
+void            shmexit(struct proc*);
+
+// swap.c
+void            swapinit(void);
+int             swapout(void);
+void*           swapalloc(int);
+void            swapreserve(uint64);
+int             swapin(struct proc*, uint64);
+void            swapdup(uint);
+void            swapfree(uint);
+void            swapminfault(void);
+int             swapstat(uint64);
+int             swapprint(char*, int);
+
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+int             slabprint(char*, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -124,6 +224,12 @@ void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// sprintf.c
+int             snprintf(char*, int, char*, ...);
+
+// stats.c
+void            statsinit(void);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -132,11 +238,18 @@ char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
+#ifdef STRINGTEST
+void            stringtest(void);
+#endif
 
 // syscall.c
 void            argint(int, int*);
 int             argstr(int, char*, int);
 void            argaddr(int, uint64 *);
+int             sysstat(int, uint64, int);
+int             ringsetup(uint64, int);
+int             ringenter(int);
+void            ringinit(void);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
@@ -147,11 +260,20 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+struct fastret  usertrap_fast(void);
+void            timerset(void);
+void            sendipi(int);
+int             sleepuntil(uint64);
+void            timeralarm(uint64);
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
-void            uartputc(int);
+void            uartputs(char*, int);
+void            uartputs_kernel(char*, int);
+int             uartputs_nowait(char*, int);
+int             uartwritable(void);
+void            uartflush_sync(void);
 void            uartputc_sync(int);
 int             uartgetc(void);
 
@@ -168,12 +290,17 @@ uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
+void            uvmunmapshared(struct proc*, uint64, uint64);
+void            tlbshootdown(struct proc*);
 void            uvmclear(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
+int             vmfault(pagetable_t, uint64, int);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+void            uvmcount(pagetable_t, uint64*);
+int             uvmprefault(uint64, uint64, int);
 
 // plic.c
 void            plicinit(void);
@@ -5,9 +5,11 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 #include "elf.h"
-
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
+#include "pagecache.h"
 
 int flags2perm(int flags)
 {
@@ -19,18 +21,53 @@ int flags2perm(int flags)
     return perm;
 }
 
+// Map the read-only pages of s that another process running ip
+// has already brought into the page cache, sharing them, so the
+// new program doesn't fault on them. Only pages execfault() would
+// share are mapped. Returns 0, or -1 if out of memory.
+// Caller must hold ip->lock.
+static int
+mapresident(pagetable_t pagetable, struct inode *ip, struct execseg *s)
+{
+  struct page *pg;
+  uint64 a;
+
+  if((s->perm & PTE_W) != 0 || s->off % PGSIZE != 0)
+    return 0;
+  for(a = 0; a + PGSIZE <= s->filesz; a += PGSIZE){
+    if((pg = pcfind(ip, (s->off + a) / PGSIZE)) == 0)
+      continue;
+    if(mappages(pagetable, s->va + a, PGSIZE, (uint64)pg->data, s->perm, PGSIZE) < 0){
+      pcput(pg);
+      return -1;
+    }
+    krefinc(pg->data);
+    pcput(pg);
+  }
+  return 0;
+}
+
+// Replace the caller's program with the one at path.
+// The program's segments are only recorded here; execfault()
+// reads each page in the first time it is touched.
 int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nseg;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe = 0, *oldexe;
   struct proghdr ph;
+  struct execseg seg[NEXECSEG];
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
+  // the other threads would be left running in a
+  // page table that is about to be freed.
+  if(p->leader != p)
+    return -1;
+
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -49,7 +86,8 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments.
+  nseg = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -59,21 +97,32 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if(ph.vaddr % PGSIZE != 0)
+    if(ph.vaddr % PGSIZE != 0 || ph.vaddr < sz)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
+    if(ph.off + ph.filesz < ph.off || ph.off + ph.filesz > ip->size)
       goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nseg == NEXECSEG)
       goto bad;
+    seg[nseg].va = ph.vaddr;
+    seg[nseg].memsz = ph.memsz;
+    seg[nseg].filesz = ph.filesz;
+    seg[nseg].off = ph.off;
+    seg[nseg].perm = flags2perm(ph.flags) | PTE_R | PTE_U;
+    nseg++;
+    sz = ph.vaddr + ph.memsz;
   }
+  if(nseg < NEXECSEG)
+    seg[nseg].memsz = 0;
+  for(i = 0; i < nseg; i++)
+    if(mapresident(pagetable, ip, &seg[i]) < 0)
+      goto bad;
+  exe = idup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
 
   p = myproc();
-  uint64 oldsz = p->sz;
+  uint64 oldsz;
 
   // Allocate some pages at the next page boundary.
   // Make the first inaccessible as a stack guard.
@@ -120,13 +169,28 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
-  // Commit to the user image.
+  // Commit to the user image. Other threads stop first;
+  // they could have grown the old one until now.
+  killthreads(p);
+  shmexit(p);
+  mmapexit(p);
+  oldsz = p->sz;
   oldpagetable = p->pagetable;
+  oldexe = p->exe;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->exe = exe;
+  p->ring = 0;
+  p->usyscall->pid = p->pid;  // the threads are gone
+  memmove(p->seg, seg, sizeof(seg));
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  if(oldexe){
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -137,30 +201,87 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
 
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+// Fill in the page at va of p's program, which p touched for
+// reading or writing. A read-only page that lies wholly within
+// the file is the page cache's page, shared by every process
+// running the program; other pages are private copies, zeroed
+// past the end of the segment's file data.
+// Returns 0, or -1 if va isn't in a segment allowing the access.
+int
+execfault(struct proc *p, uint64 va, int write)
 {
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
+  struct proc *l = p->leader;
+  struct execseg *s, seg;
+  struct page *pg;
+  pte_t *pte;
+  char *mem;
+  uint64 n;
+  uint off;
+  int r, locked;
+
+  va = PGROUNDDOWN(va);
+
+  // l->exe can't change while one of its threads is running here:
+  // exec and exit stop the other threads first.
+  acquire(&l->vmlock);
+  for(s = l->seg; s < &l->seg[NEXECSEG] && s->memsz; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      break;
+  if(l->exe == 0 || s == &l->seg[NEXECSEG] || s->memsz == 0 ||
+     (write && (s->perm & PTE_W) == 0)){
+    release(&l->vmlock);
+    return -1;
   }
-  
-  return 0;
+  seg = *s;
+  release(&l->vmlock);
+
+  off = seg.off + (va - seg.va);
+  n = va - seg.va < seg.filesz ? seg.filesz - (va - seg.va) : 0;
+  if(n > PGSIZE)
+    n = PGSIZE;
+
+  mem = 0;
+  // fileread() and filewrite() fault their buffers in before
+  // locking the file, so no other inode's lock is held here,
+  // but a read() of the program into itself may hold this one.
+  if((locked = holdingsleep(&l->exe->lock)) == 0)
+    ilock(l->exe);
+  if(n == PGSIZE && (seg.perm & PTE_W) == 0 && off % PGSIZE == 0){
+    if((pg = pcget(l->exe, off / PGSIZE)) != 0){
+      mem = pg->data;
+      krefinc(mem);
+      pcput(pg);
+    }
+  } else if((mem = swapalloc(n == 0)) != 0){
+    if(n > 0)
+      memset(mem + n, 0, PGSIZE - n);
+    if(n > 0 && readi(l->exe, 0, (uint64)mem, off, n) != n){
+      kfree(mem);
+      mem = 0;
+    }
+  }
+  if(!locked)
+    iunlock(l->exe);
+  if(mem == 0)
+    return -1;
+
+  r = 0;
+  acquire(&l->vmlock);
+  if((pte = walk(l->pagetable, va, 0)) != 0 && (*pte & PTE_V)){
+    // another thread faulted it in first.
+    kfree(mem);
+  } else if(mappages(l->pagetable, va, PGSIZE, (uint64)mem, seg.perm, PGSIZE) < 0){
+    kfree(mem);
+    r = -1;
+  }
+  release(&l->vmlock);
+  return r;
 }
@@ -12,35 +12,36 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "fcntl.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
+// open files come from filecache; ftable.lock protects
+// their reference counts.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct kmem_cache *filecache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  ftable.filecache = kmem_cache_create("file", sizeof(struct file));
 }
 
 // Allocate a file structure.
+// Returns 0 if out of memory.
 struct file*
 filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = kmem_cache_alloc(ftable.filecache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -55,6 +56,26 @@ filedup(struct file *f)
   return f;
 }
 
+// Return the file open as fd in the current process, with a
+// reference the caller must fileclose(), or 0 if none. The
+// leader's lock keeps a thread sharing the table from closing
+// and freeing it before the reference is taken.
+struct file*
+fdfile(int fd)
+{
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&l->lock);
+  if((f = p->ofile[fd]) != 0)
+    filedup(f);
+  release(&l->lock);
+  return f;
+}
+
 // Close file f.  (Decrement ref count, close when reaches 0.)
 void
 fileclose(struct file *f)
@@ -69,9 +90,8 @@ fileclose(struct file *f)
     return;
   }
   ff = *f;
-  f->ref = 0;
-  f->type = FD_NONE;
   release(&ftable.lock);
+  kmem_cache_free(ftable.filecache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -101,6 +121,46 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Which of POLLIN, POLLOUT, POLLHUP and POLLERR hold for f.
+int
+filepoll(struct file *f)
+{
+  int r;
+
+  if(f->type == FD_PIPE){
+    r = f->readable ? pipepoll(f->pipe) & (POLLIN|POLLHUP) :
+                      pipepoll(f->pipe) & (POLLOUT|POLLERR);
+  } else if(f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV &&
+            devsw[f->major].poll){
+    r = devsw[f->major].poll(f->minor);
+  } else {
+    r = POLLIN | POLLOUT;
+  }
+  if(!f->readable)
+    r &= ~POLLIN;
+  if(!f->writable)
+    r &= ~POLLOUT;
+  return r;
+}
+
+// Carry out fcntl() command cmd with argument arg on f.
+// Returns what F_GETFL asks for, 0, or -1.
+int
+filefcntl(struct file *f, int cmd, int arg)
+{
+  int mode;
+
+  switch(cmd){
+  case F_GETFL:
+    mode = f->readable && f->writable ? O_RDWR : f->writable ? O_WRONLY : O_RDONLY;
+    return mode | (f->nonblock ? O_NONBLOCK : 0);
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -112,16 +172,53 @@ fileread(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
+    if(f->major < 0 || f->major >= NDEV)
+      return -1;
+    if(devsw[f->major].pread){
+      // no lock: concurrent readers of one file may see the
+      // same bytes, as with a shared console.
+      if((r = devsw[f->major].pread(f->minor, addr, f->off, n)) > 0)
+        f->off += r;
+    } else if(devsw[f->major].read){
+      // another reader may get there first, so a non-blocking
+      // read of a shared device can still wait.
+      if(f->nonblock && devsw[f->major].poll &&
+         (devsw[f->major].poll(f->minor) & POLLIN) == 0)
+        return -1;
+      r = devsw[f->major].read(1, addr, n);
+    } else {
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+    }
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    // a fault in the copy could need the lock of the program
+    // or of a mapped file, which another reader of this one
+    // might hold while it waits for ours; so fault in first,
+    // a page at a time, stopping at the end of the file.
+    int i = 0, n1;
+    r = 0;
+    while(i < n){
+      n1 = PGSIZE - (addr + i) % PGSIZE;
+      if(n1 > n - i)
+        n1 = n - i;
+      if((n1 = uvmprefault(addr + i, n1, 1)) == 0){
+        r = -1;
+        break;
+      }
+      ilock(f->ip);
+      if((r = readi(f->ip, 1, addr + i, f->off, n1)) > 0)
+        f->off += r;
+      iunlock(f->ip);
+      if(r < 0)
+        break;
+      i += r;
+      if(r < n1)
+        break;
+    }
+    // what was read stands, even if a later page failed.
+    if(i > 0)
+      r = i;
   } else {
     panic("fileread");
   }
@@ -140,10 +237,13 @@ filewrite(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
+    if(f->nonblock && devsw[f->major].poll &&
+       (devsw[f->major].poll(f->minor) & POLLOUT) == 0)
+      return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
@@ -153,12 +253,20 @@ filewrite(struct file *f, uint64 addr, int n)
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
+    int i = 0, m, fault = 0;
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
         n1 = max;
 
+      // fault in before taking the lock, as in fileread();
+      // a page that can't be mapped ends the write there.
+      if((m = uvmprefault(addr + i, n1, 0)) < n1){
+        fault = 1;
+        if((n1 = m) == 0)
+          break;
+      }
+
       begin_op();
       ilock(f->ip);
       if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
@@ -171,8 +279,10 @@ filewrite(struct file *f, uint64 addr, int n)
         break;
       }
       i += r;
+      if(fault)
+        break;
     }
-    ret = (i == n ? n : -1);
+    ret = (i == n || (fault && i > 0) ? i : -1);
   } else {
     panic("filewrite");
   }
@@ -180,3 +290,41 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// Describe each open file in ofile, one line each, for
+// /proc/files. Returns the length.
+int
+fileprint(int pid, struct file **ofile, char *buf, int sz)
+{
+  static char *types[] = {
+  [FD_NONE]   "none",
+  [FD_PIPE]   "pipe",
+  [FD_INODE]  "inode",
+  [FD_DEVICE] "device",
+  };
+  struct file *f;
+  int fd, off = 0;
+
+  // an ofile entry holds a reference, and is cleared before
+  // fileclose() drops it. fileclose() drops references with
+  // ftable.lock held, so a file found in ofile while holding
+  // it here still has a reference, and it and its inode can't
+  // be freed until this releases the lock. (fileclose() frees
+  // the file after releasing ftable.lock; what makes that safe
+  // is that no one else holds a reference by then.)
+  acquire(&ftable.lock);
+  for(fd = 0; fd < NOFILE && off < sz-1; fd++){
+    if((f = ofile[fd]) == 0)
+      continue;
+    off += snprintf(buf+off, sz-off, "%d %d %s %d %c%c", pid, fd, types[f->type],
+                    f->ref, f->readable ? 'r' : '-', f->writable ? 'w' : '-');
+    if(f->type == FD_INODE)
+      off += snprintf(buf+off, sz-off, " inum=%d off=%d\n", f->ip->inum, f->off);
+    else if(f->type == FD_DEVICE)
+      off += snprintf(buf+off, sz-off, " dev=%d,%d\n", f->major, f->minor);
+    else
+      off += snprintf(buf+off, sz-off, "\n");
+  }
+  release(&ftable.lock);
+  return off;
+}
@@ -3,10 +3,12 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK: read and write return -1 rather than wait
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
-  uint off;          // FD_INODE
+  uint off;          // FD_INODE, and FD_DEVICE with a pread
   short major;       // FD_DEVICE
+  short minor;       // FD_DEVICE
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
@@ -18,6 +20,7 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *next; // itable hash chain
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -30,11 +33,19 @@ struct inode {
 };
 
 // map major device number to device functions.
+// a device with pread is read like a file, at the file offset:
+// pread(minor, user dst, off, n).
+// poll(minor) returns POLLIN and POLLOUT if a read or write
+// wouldn't block; a device without one never blocks.
 struct devsw {
   int (*read)(int, uint64, int);
   int (*write)(int, uint64, int);
+  int (*pread)(int, uint64, uint, int);
+  int (*poll)(int);
 };
 
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define STATS   2
+#define PROCFS  3
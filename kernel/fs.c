@@ -164,29 +164,31 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// In-memory inodes come from itable.cache and are kept in a
+// hash table while referenced; the last iput() frees one.
+// The itable.lock spin-lock protects the hash table. Since
+// ip->ref indicates whether an entry is in use, and ip->dev
+// and ip->inum indicate which i-node an entry holds, one must
+// hold itable.lock while using any of those fields.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 61
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NIHASH)
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct kmem_cache *cache;
+  struct inode *hash[NIHASH];
 } itable;
 
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
-  }
+  itable.cache = kmem_cache_create("inode", sizeof(struct inode));
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -194,23 +196,30 @@ static struct inode* iget(uint dev, uint inum);
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode,
-// or NULL if there is no free inode.
+// or NULL if there is no free inode or no memory for one.
 struct inode*
 ialloc(uint dev, short type)
 {
   int inum;
   struct buf *bp;
   struct dinode *dip;
+  struct inode *ip;
 
   for(inum = 1; inum < sb.ninodes; inum++){
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
+      // get the in-memory copy first, so that running out
+      // of memory doesn't leave the inode allocated on disk.
+      if((ip = iget(dev, inum)) == 0){
+        brelse(bp);
+        return 0;
+      }
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
-      return iget(dev, inum);
+      return ip;
     }
     brelse(bp);
   }
@@ -243,34 +252,35 @@ iupdate(struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
+// Returns 0 if there is no memory for a new copy.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
+  int h = IHASH(dev, inum);
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  for(ip = itable.hash[h]; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
+  if((ip = kmem_cache_alloc(itable.cache)) == 0){
+    release(&itable.lock);
+    return 0;
+  }
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  initsleeplock(&ip->lock, "inode");
+  ip->next = itable.hash[h];
+  itable.hash[h] = ip;
   release(&itable.lock);
 
   return ip;
@@ -327,8 +337,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode table entry can
-// be recycled.
+// If that was the last reference, the inode table entry is
+// freed.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -357,7 +367,13 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    struct inode **pp;
+    for(pp = &itable.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->next)
+      ;
+    *pp = ip->next;
+    kmem_cache_free(itable.cache, ip);
+  }
   release(&itable.lock);
 }
 
@@ -379,7 +395,7 @@ iunlockput(struct inode *ip)
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 // returns 0 if out of disk space.
-static uint
+uint
 bmap(struct inode *ip, uint bn)
 {
   uint addr, *a;
@@ -450,6 +466,7 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  pcinval(ip);
 }
 
 // Copy stat information from inode.
@@ -471,14 +488,27 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
-
   if(off > ip->size || off + n < off)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
 
+  // file data comes from the page cache; bcache
+  // only holds it on the way in.
+  if(ip->type == T_FILE)
+    return pcread(ip, user_dst, dst, off, n);
+  return readblocks(ip, user_dst, dst, off, n);
+}
+
+// Read n bytes of ip at off through bcache, as readi() does
+// for all but files. off and n must be within the file.
+// Caller must hold ip->lock.
+int
+readblocks(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  uint tot, m;
+  struct buf *bp;
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
@@ -523,6 +553,9 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       brelse(bp);
       break;
     }
+    // writes go through the log, and update any cached copy.
+    if(ip->type == T_FILE)
+      pcupdate(ip, off, (char*)bp->data + (off % BSIZE), m);
     log_write(bp);
     brelse(bp);
   }
@@ -548,6 +581,7 @@ namecmp(const char *s, const char *t)
 
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Returns 0 if not found or if out of memory.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
@@ -579,23 +613,24 @@ dirlookup(struct inode *dp, char *name, uint *poff)
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
+  int off, empty;
   struct dirent de;
-  struct inode *ip;
-
-  // Check that name is not present.
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iput(ip);
-    return -1;
-  }
 
-  // Look for an empty dirent.
+  // Check that name is not present, and look for an
+  // empty dirent. Not with dirlookup(): it returns 0
+  // for a name that is present if out of memory.
+  empty = -1;
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlink read");
-    if(de.inum == 0)
-      break;
+    if(de.inum == 0){
+      if(empty < 0)
+        empty = off;
+    } else if(namecmp(name, de.name) == 0)
+      return -1;
   }
+  if(empty >= 0)
+    off = empty;
 
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
@@ -653,9 +688,10 @@ namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
 
-  if(*path == '/')
-    ip = iget(ROOTDEV, ROOTINO);
-  else
+  if(*path == '/'){
+    if((ip = iget(ROOTDEV, ROOTINO)) == 0)
+      return 0;
+  } else
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
@@ -21,12 +21,36 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  uint64 nfree;
 } kmem;
 
+// Free pages already zeroed by idle CPUs, for kalloc_zeroed().
+// kalloc() takes from here too once kmem.freelist is empty.
+#define NZEROPOOL 256
+
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  uint64 n;
+} zpool;
+
+// Reference counts of allocated pages, for pages mapped
+// by more than one page table. kalloc() returns a page
+// with one reference, and kfree() only frees it when the
+// last reference is dropped.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
+struct {
+  struct spinlock lock;
+  int count[PA2REF(PHYSTOP)];
+} kref;
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&zpool.lock, "zpool");
+  initlock(&kref.lock, "kref");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,33 +59,91 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kref.count[PA2REF(p)] = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Add a reference to an allocated page.
+void
+krefinc(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("krefinc");
+
+  acquire(&kref.lock);
+  if(kref.count[PA2REF(pa)] < 1)
+    panic("krefinc: free page");
+  kref.count[PA2REF(pa)]++;
+  release(&kref.lock);
+}
+
+// The number of references to an allocated page.
+int
+krefcount(void *pa)
+{
+  int n;
+
+  acquire(&kref.lock);
+  n = kref.count[PA2REF(pa)];
+  release(&kref.lock);
+  return n;
+}
+
+// Drop a reference to the page of physical memory pointed
+// at by pa, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last.
+// (The exception is when initializing the allocator;
+// see kinit above.)
 void
 kfree(void *pa)
 {
   struct run *r;
+  int n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  acquire(&kref.lock);
+  if((n = --kref.count[PA2REF(pa)]) < 0)
+    panic("kfree: free page");
+  release(&kref.lock);
+  if(n > 0)
+    return;
+
+#ifdef KALLOC_DEBUG
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
   acquire(&kmem.lock);
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   release(&kmem.lock);
 }
 
+// take a page from the zeroed pool, or return 0.
+static struct run*
+zpoolget(void)
+{
+  struct run *r;
+
+  acquire(&zpool.lock);
+  r = zpool.freelist;
+  if(r){
+    zpool.freelist = r->next;
+    zpool.n--;
+  }
+  release(&zpool.lock);
+  if(r)
+    r->next = 0;  // the only non-zero word
+  return r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -72,15 +154,85 @@ kalloc(void)
 
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+  }
   release(&kmem.lock);
 
-  if(r)
+  if(r == 0)
+    r = zpoolget();
+  if(r){
+    kref.count[PA2REF(r)] = 1;
+#ifdef KALLOC_DEBUG
     memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+  }
+  return (void*)r;
+}
+
+// Allocate a page of zeroes, from the pool if it has one.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if((r = zpoolget()) == 0){
+    if((r = kalloc()) != 0)
+      memset((char*)r, 0, PGSIZE);
+    return (void*)r;
+  }
+  kref.count[PA2REF(r)] = 1;
   return (void*)r;
 }
 
+// Zero a free page into the pool if the pool is short.
+// Called by scheduler() when a CPU has nothing to run.
+// Returns 1 if it zeroed a page.
+int
+kzeroidle(void)
+{
+  struct run *r;
+
+  if(zpool.n >= NZEROPOOL)
+    return 0;
+
+  acquire(&kmem.lock);
+  r = kmem.freelist;
+  if(r){
+    kmem.freelist = r->next;
+    kmem.nfree--;
+  }
+  release(&kmem.lock);
+  if(r == 0)
+    return 0;
+
+  memset((char*)r, 0, PGSIZE);
+
+  acquire(&zpool.lock);
+  r->next = zpool.freelist;
+  zpool.freelist = r;
+  zpool.n++;
+  release(&zpool.lock);
+  return 1;
+}
+
+// The number of free pages.
+uint64
+kfreepages(void)
+{
+  return kmem.nfree + zpool.n;
+}
+
+// Describe the page allocator, for /proc/mem.
+int
+kmemprint(char *buf, int sz)
+{
+  return snprintf(buf, sz, "pages %ld\nfree %ld\nzeroed %ld\n",
+                  (PHYSTOP - PGROUNDUP((uint64)end)) / PGSIZE, kmem.nfree, zpool.n);
+}
+
 void *
 kalloc_superpage(void)
 {
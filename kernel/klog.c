@@ -0,0 +1,155 @@
+// Kernel log: what printf() prints, with timestamps and CPU
+// ids, in a ring of NKLOG records that dmesg() reads.
+//
+// The log takes no lock. A writer claims the next record with
+// an atomic add to klog.next and clears the record's seq while
+// it fills it in, setting seq last; so a reader sees a record
+// whole, or sees seq change under it, when a writer that has
+// gone round the ring reuses it, and discards its copy.
+//
+// Records reach the console in the background: whoever finds
+// klog.draining clear moves records to the uart's output
+// buffer until it is full, and the uart interrupt carries on
+// from there. So printf() doesn't wait for the uart, and when
+// output comes faster than the uart sends it, the oldest is
+// lost from the console but stays for dmesg() while it lasts.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "klog.h"
+#include "defs.h"
+
+struct {
+  uint64 next;            // seq of the next record to claim
+  int draining;           // someone is in klogdrain()
+  uint64 drained;         // next record for the console
+  int off;                // bytes of it already sent
+  struct klogrec rec[NKLOG];
+} klog;
+
+// copy record s to *r. returns 0, -1 if it isn't written yet,
+// or 1 if it has been overwritten.
+static int
+klogget(uint64 s, struct klogrec *r)
+{
+  struct klogrec *k = &klog.rec[s % NKLOG];
+  uint64 seq;
+
+  seq = __atomic_load_n(&k->seq, __ATOMIC_ACQUIRE);
+  if(seq != s + 1)
+    return (seq > s + 1 || klog.next > s + NKLOG) ? 1 : -1;
+  *r = *k;
+  __sync_synchronize();
+  if(__atomic_load_n(&k->seq, __ATOMIC_RELAXED) != s + 1)
+    return 1;
+  return 0;
+}
+
+// is a written record waiting for the console?
+static int
+klogpending(void)
+{
+  uint64 s = klog.drained;
+
+  return __atomic_load_n(&klog.rec[s % NKLOG].seq, __ATOMIC_ACQUIRE) == s + 1;
+}
+
+// Move records to the uart's output buffer, as far as it has
+// room. Called after writing a record, and by the uart
+// interrupt as room opens up.
+void
+klogdrain(void)
+{
+  struct klogrec r;
+  int x, m;
+
+  for(;;){
+    if(__sync_lock_test_and_set(&klog.draining, 1))
+      return;
+    while((x = klogget(klog.drained, &r)) >= 0){
+      if(x == 1){
+        // lost to writers going round the ring.
+        klog.drained++;
+        if(klog.next > klog.drained + NKLOG)
+          klog.drained = klog.next - NKLOG;
+        klog.off = 0;
+        continue;
+      }
+      m = uartputs_nowait(r.text + klog.off, r.n - klog.off);
+      klog.off += m;
+      if(klog.off < r.n)
+        break;
+      klog.drained++;
+      klog.off = 0;
+    }
+    __sync_lock_release(&klog.draining);
+
+    // a record written meanwhile may have found us draining.
+    if(!klogpending() || !uartwritable())
+      return;
+  }
+}
+
+// Add n bytes of text, n <= KLOGTEXT, to the log, as output of
+// this CPU; line says whether it starts a line.
+// Interrupts must be off.
+void
+klogwrite(char *s, int n, int line)
+{
+  struct klogrec *k;
+  uint64 seq;
+
+  seq = __sync_fetch_and_add(&klog.next, 1);
+  k = &klog.rec[seq % NKLOG];
+  __atomic_store_n(&k->seq, 0, __ATOMIC_RELAXED);
+  __sync_synchronize();
+  k->time = r_time();
+  k->cpu = cpuid();
+  k->line = line;
+  k->n = n;
+  memmove(k->text, s, n);
+  __atomic_store_n(&k->seq, seq + 1, __ATOMIC_RELEASE);
+
+  klogdrain();
+}
+
+// Send the records the console hasn't had straight to the
+// uart, for panic().
+void
+klogflush_sync(void)
+{
+  struct klogrec r;
+  int x;
+
+  for(; (x = klogget(klog.drained, &r)) >= 0; klog.drained++, klog.off = 0)
+    if(x == 0)
+      for(; klog.off < r.n; klog.off++)
+        uartputc_sync(r.text[klog.off]);
+}
+
+// Copy up to n of the records in the log, oldest first, to
+// user address addr. Returns the number copied, or -1.
+int
+dmesg(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct klogrec r;
+  uint64 s, end;
+  int i = 0;
+
+  if(n < 0)
+    return -1;
+  end = klog.next;
+  s = end > NKLOG ? end - NKLOG : 0;
+  for(; s < end && i < n; s++){
+    if(klogget(s, &r) != 0)
+      continue;
+    if(copyout(p->pagetable, addr + i * sizeof(r), (char*)&r, sizeof(r)) < 0)
+      return -1;
+    i++;
+  }
+  return i;
+}
@@ -0,0 +1,14 @@
+// Kernel log records, as dmesg() copies them out. Each holds
+// the output of one printf(), or a piece of a long one.
+
+#define NKLOG    256   // records kept
+#define KLOGTEXT 112   // text bytes in a record
+
+struct klogrec {
+  uint64 seq;        // 1 + its place in the log; 0 while being written
+  uint64 time;       // time CSR when written
+  uchar cpu;
+  uchar line;        // text starts a line
+  ushort n;          // text bytes
+  char text[KLOGTEXT];  // not null-terminated
+};
@@ -45,6 +45,14 @@ struct log {
   int committing;  // in commit(), please wait.
   int dev;
   struct logheader lh;
+
+  // statistics, protected by lock, except that only the
+  // committer updates the last two.
+  uint64 ops;      // begin_op()s
+  uint64 waits;    // times begin_op() had to sleep
+  uint64 absorbed; // log_write()s of blocks already in the log
+  uint64 commits;
+  uint64 blocks;   // blocks written by commits
 };
 struct log log;
 
@@ -127,11 +135,14 @@ void
 begin_op(void)
 {
   acquire(&log.lock);
+  log.ops++;
   while(1){
     if(log.committing){
+      log.waits++;
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
+      log.waits++;
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
@@ -194,6 +205,8 @@ static void
 commit()
 {
   if (log.lh.n > 0) {
+    log.commits++;
+    log.blocks += log.lh.n;
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
     install_trans(0); // Now install writes to home locations
@@ -230,7 +243,23 @@ log_write(struct buf *b)
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
     log.lh.n++;
+  } else {
+    log.absorbed++;
   }
   release(&log.lock);
 }
 
+// Describe the log, for /proc/log.
+int
+logprint(char *buf, int sz)
+{
+  int n;
+
+  acquire(&log.lock);
+  n = snprintf(buf, sz, "size %d\noutstanding %d\ncommitting %d\nlogged %d\n"
+               "ops %ld\nwaits %ld\nabsorbed %ld\ncommits %ld\nblocks %ld\n",
+               log.size, log.outstanding, log.committing, log.lh.n,
+               log.ops, log.waits, log.absorbed, log.commits, log.blocks);
+  release(&log.lock);
+  return n;
+}
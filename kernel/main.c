@@ -12,21 +12,33 @@ main()
 {
   if(cpuid() == 0){
     consoleinit();
-    printfinit();
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
+    slabinit();      // small object caches
+#ifdef STRINGTEST
+    stringtest();    // check and time memset etc.
+#endif
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
+    shminit();       // shared memory segments
     trapinit();      // trap vectors
+    profinit();      // sampling profiler
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    pcinit();        // page cache
+    swapinit();      // swap area
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    pollinit();      // poll() wakeups
+    ringinit();      // ringenter() turns
+    statsinit();     // lock statistics device
+    procfsinit();    // kernel state files
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -17,6 +17,11 @@
 // end -- start of kernel page allocation area
 // PHYSTOP -- end RAM used by the kernel
 
+// core local interruptor (CLINT); only its software interrupt
+// registers are used, to interrupt another hart.
+#define CLINT 0x02000000L
+#define CLINT_MSIP(hart) (CLINT + 4*(hart))
+
 // qemu puts UART registers here in physical memory.
 #define UART0 0x10000000L
 #define UART0_IRQ 10
@@ -45,7 +50,7 @@
 
 // map kernel stacks beneath the trampoline,
 // each surrounded by invalid guard pages.
-#define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
+#define KSTACK(i) (TRAMPOLINE - ((uint64)(i)+1)* 2*PGSIZE)
 
 // User memory layout.
 // Address zero first:
@@ -54,6 +59,36 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   MMAPBASE (mmap()ed files)
+//   ...
+//   SHMBASE (windows for attached shared memory segments)
+//   ...
+//   USYSCALL (read-only data for ulib)
+//   trapframes of threads created by clone()
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// mmap() places files between MMAPBASE and SHMBASE.
+#define MMAPBASE (MAXVA / 4)
+
+// shared memory segment attachment i is mapped at SHMWINDOW(i).
+#define SHMBASE (MAXVA / 2)
+#define SHMWINDOW(i) (SHMBASE + (uint64)(i) * SHMMAXPAGES * PGSIZE)
+
+// trapframe of the thread in slot i of a process;
+// slot 0 is the main thread.
+#define THREADFRAME(i) (TRAPFRAME - (i)*PGSIZE)
+
+// a read-only page below the thread trapframes, from which ulib
+// answers getpid(), uptime() and clock_gettime() without a trap.
+#define USYSCALL THREADFRAME(NTHREAD)
+
+#ifndef __ASSEMBLER__
+struct usyscall {
+  int pid;           // the process's, or 0 once it has threads
+  uint pad;
+  uint64 timebase;   // time CSR cycles per second
+  uint64 tickcycles; // time CSR cycles per tick, for uptime()
+};
+#endif
@@ -0,0 +1,378 @@
+// Memory-mapped files.
+//
+// mmap() only records a vma in the leader thread; pages are
+// filled by mmapfault() on first touch. MAP_SHARED maps the
+// page cache's page, so all sharers and read()/write() see the
+// same data; MAP_PRIVATE gets a copy. munmap() and exit write
+// MAP_SHARED pages that the mapping allows writes to back to
+// the file, without growing it. Without PROT_WRITE the cache's
+// page is mapped without PTE_W, which copyout() also honours, so
+// a read() into the mapping can't change the file.
+//
+// A process's vmas are protected by its leader's vmlock. The
+// lock is dropped around file I/O, so each step re-checks the
+// vma after sleeping.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "stat.h"
+#include "pagecache.h"
+#include "defs.h"
+
+// the vma of l containing va, or 0.
+// l->vmlock must be held.
+static struct vma*
+findvma(struct proc *l, uint64 va)
+{
+  struct vma *v;
+
+  for(v = l->vma; v < &l->vma[NVMA]; v++)
+    if(v->addr && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// lowest free address range of len bytes above MMAPBASE,
+// or 0 if none.
+// l->vmlock must be held.
+static uint64
+mmapaddr(struct proc *l, uint64 len)
+{
+  struct vma *v;
+  uint64 a = MMAPBASE;
+
+again:
+  for(v = l->vma; v < &l->vma[NVMA]; v++){
+    if(v->addr && a < v->addr + v->len && v->addr < a + len){
+      a = v->addr + v->len;
+      goto again;
+    }
+  }
+  if(a + len > SHMBASE)
+    return 0;
+  return a;
+}
+
+static int
+vmaperm(struct vma *v)
+{
+  int perm = PTE_U;
+
+  if(v->prot & PROT_READ)
+    perm |= PTE_R;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_R | PTE_W;
+  if(v->prot & PROT_EXEC)
+    perm |= PTE_X;
+  return perm;
+}
+
+// Map len bytes of f starting at off, which must be page-aligned,
+// into the caller's address space. Returns the address, or -1.
+uint64
+mmap(uint64 len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *l = myproc()->leader;
+  struct vma *v;
+  uint64 addr;
+
+  if(len == 0 || off % PGSIZE != 0 || f->type != FD_INODE || f->ip->type != T_FILE)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  // pages are always read in, even if the mapping is write-only.
+  if(!f->readable)
+    return -1;
+  if(flags == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)
+    return -1;
+  len = PGROUNDUP(len);
+
+  acquire(&l->vmlock);
+  for(v = l->vma; v < &l->vma[NVMA]; v++)
+    if(v->addr == 0)
+      break;
+  if(v == &l->vma[NVMA] || (addr = mmapaddr(l, len)) == 0){
+    release(&l->vmlock);
+    return -1;
+  }
+  v->addr = addr;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->off = off;
+  v->f = filedup(f);
+  release(&l->vmlock);
+  return addr;
+}
+
+// Fill in the page at va of a mapped file, which p
+// touched for reading or writing.
+// Returns 0, or -1 if va isn't mapped for that access.
+int
+mmapfault(struct proc *p, uint64 va, int write)
+{
+  struct proc *l = p->leader;
+  struct vma *v;
+  struct file *f;
+  struct page *pg;
+  pte_t *pte;
+  char *mem;
+  uint off;
+  int r, shared, locked;
+
+  va = PGROUNDDOWN(va);
+
+  acquire(&l->vmlock);
+  if((v = findvma(l, va)) == 0 || (v->prot & (PROT_READ | PROT_WRITE)) == 0 ||
+     (write && (v->prot & PROT_WRITE) == 0)){
+    release(&l->vmlock);
+    return -1;
+  }
+  // keep the file open while reading, even if unmapped meanwhile.
+  f = filedup(v->f);
+  off = v->off + (va - v->addr);
+  shared = v->flags == MAP_SHARED;
+  release(&l->vmlock);
+
+  r = -1;
+  // as in execfault(), the only inode lock the faulting
+  // copy can hold is this file's own.
+  if((locked = holdingsleep(&f->ip->lock)) == 0)
+    ilock(f->ip);
+  if((pg = pcget(f->ip, off / PGSIZE)) == 0){
+    if(!locked)
+      iunlock(f->ip);
+    goto out;
+  }
+  // bytes past the end of the file are zero in the cache.
+  if(shared){
+    mem = pg->data;
+    krefinc(mem);
+  } else if((mem = swapalloc(0)) != 0){
+    memmove(mem, pg->data, PGSIZE);
+  }
+  pcput(pg);
+  if(!locked)
+    iunlock(f->ip);
+  if(mem == 0)
+    goto out;
+
+  acquire(&l->vmlock);
+  if((v = findvma(l, va)) == 0){
+    kfree(mem);
+  } else if((pte = walk(l->pagetable, va, 0)) != 0 && (*pte & PTE_V)){
+    // another thread faulted it in first.
+    kfree(mem);
+    r = 0;
+  } else if(mappages(l->pagetable, va, PGSIZE, (uint64)mem, vmaperm(v), PGSIZE) < 0){
+    kfree(mem);
+  } else {
+    r = 0;
+  }
+  release(&l->vmlock);
+
+out:
+  fileclose(f);
+  return r;
+}
+
+// Write the mapped page at pa back to f at off,
+// stopping at the end of the file.
+static void
+writeback(struct file *f, uint off, uint64 pa)
+{
+  struct inode *ip = f->ip;
+  // the maximum log transaction size, as in filewrite().
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint i, n;
+
+  for(i = 0; i < PGSIZE; i += n){
+    begin_op();
+    ilock(ip);
+    if(off + i >= ip->size){
+      iunlock(ip);
+      end_op();
+      break;
+    }
+    n = PGSIZE - i;
+    if(n > max)
+      n = max;
+    if(n > ip->size - (off + i))
+      n = ip->size - (off + i);
+    writei(ip, 0, pa + i, off + i, n);
+    iunlock(ip);
+    end_op();
+  }
+}
+
+// Unmap and free the pages of [start, end) of l that were faulted
+// in, writing them back to f at off first if wb is set.
+// The caller has already removed the range from l's vmas.
+// Other threads may write the pages until tlbshootdown(), so
+// they are written back and freed in batches after one.
+#define NVMAUNMAP 16
+static void
+vmaunmap(struct proc *l, uint64 start, uint64 end, struct file *f, uint off, int wb)
+{
+  pte_t *pte;
+  uint64 a, va[NVMAUNMAP], pa[NVMAUNMAP];
+  int i, n;
+
+  for(a = start; a < end; ){
+    n = 0;
+    acquire(&l->vmlock);
+    for(; a < end && n < NVMAUNMAP; a += PGSIZE){
+      if((pte = walk(l->pagetable, a, 0)) != 0 && (*pte & PTE_V)){
+        va[n] = a;
+        pa[n++] = PTE2PA(*pte);
+        *pte = 0;
+      }
+    }
+    release(&l->vmlock);
+    if(n == 0)
+      continue;
+    tlbshootdown(l);
+    for(i = 0; i < n; i++){
+      if(wb)
+        writeback(f, off + (va[i] - start), pa[i]);
+      kfree((void*)pa[i]);
+    }
+  }
+}
+
+// Unmap [addr, addr+len) from the caller's address space. The
+// range must start or end a mapping; punching a hole is not
+// supported.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *l = myproc()->leader;
+  struct vma *v;
+  struct file *f;
+  uint64 end;
+  uint off;
+  int wb;
+
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+
+  acquire(&l->vmlock);
+  if((v = findvma(l, addr)) == 0){
+    release(&l->vmlock);
+    return -1;
+  }
+  end = addr + PGROUNDUP(len);
+  if(end > v->addr + v->len)
+    end = v->addr + v->len;
+  if(addr != v->addr && end != v->addr + v->len){
+    release(&l->vmlock);
+    return -1;
+  }
+  f = v->f;
+  off = v->off + (addr - v->addr);
+  wb = v->flags == MAP_SHARED && (v->prot & PROT_WRITE);
+  if(addr == v->addr && end == v->addr + v->len){
+    // the vma's file reference is now ours.
+    v->addr = 0;
+    v->f = 0;
+  } else {
+    f = filedup(f);
+    if(addr == v->addr){
+      v->off += end - addr;
+      v->addr = end;
+    }
+    v->len -= end - addr;
+  }
+  release(&l->vmlock);
+
+  vmaunmap(l, addr, end, f, off, wb);
+  fileclose(f);
+  return 0;
+}
+
+// Give np, a new child of p, copies of p's mappings. MAP_SHARED
+// pages are shared with the parent; MAP_PRIVATE pages are copied.
+// Returns 0, or -1 with nothing mapped. Doesn't sleep.
+int
+mmapfork(struct proc *p, struct proc *np)
+{
+  struct proc *l = p->leader;
+  struct vma *v, *nv;
+  pte_t *pte;
+  uint64 a, pa;
+  char *mem;
+
+  acquire(&l->vmlock);
+  for(v = l->vma, nv = np->vma; v < &l->vma[NVMA]; v++, nv++){
+    if(v->addr == 0)
+      continue;
+    *nv = *v;
+    filedup(nv->f);
+    for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      if((pte = walk(l->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+        continue;
+      pa = PTE2PA(*pte);
+      if(v->flags == MAP_SHARED){
+        mem = (char*)pa;
+        krefinc(mem);
+      } else if((mem = kalloc()) != 0){
+        memmove(mem, (char*)pa, PGSIZE);
+      } else {
+        goto bad;
+      }
+      if(mappages(np->pagetable, a, PGSIZE, (uint64)mem, PTE_FLAGS(*pte), PGSIZE) < 0){
+        kfree(mem);
+        goto bad;
+      }
+    }
+  }
+  release(&l->vmlock);
+  return 0;
+
+ bad:
+  release(&l->vmlock);
+  // drop what was mapped; the parent still holds
+  // every file, so fileclose() won't sleep.
+  for(nv = np->vma; nv < &np->vma[NVMA]; nv++){
+    if(nv->addr == 0)
+      continue;
+    vmaunmap(np, nv->addr, nv->addr + nv->len, 0, 0, 0);
+    fileclose(nv->f);
+    nv->addr = 0;
+    nv->f = 0;
+  }
+  return -1;
+}
+
+// Unmap all of p's files, writing shared pages back,
+// before its page table is freed or replaced. p must
+// be a leader with no other threads.
+void
+mmapexit(struct proc *p)
+{
+  struct vma *v;
+  struct file *f;
+  uint64 addr, len;
+  int wb;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr == 0)
+      continue;
+    addr = v->addr;
+    len = v->len;
+    f = v->f;
+    wb = v->flags == MAP_SHARED && (v->prot & PROT_WRITE);
+    v->addr = 0;
+    v->f = 0;
+    vmaunmap(p, addr, addr + len, f, v->off, wb);
+    fileclose(f);
+  }
+}
@@ -0,0 +1,318 @@
+// Page cache.
+//
+// Holds the data of regular files in whole pages, keyed by
+// (dev, inum, page index), so bcache is left to metadata and
+// mmap() can map the cached pages directly.
+//
+// Interface:
+// * pcget() returns a referenced page of a file, reading it
+//   in through bcache if it isn't cached.
+// * pcfind() is pcget() for a page only if it is cached.
+// * pcput() drops the reference.
+// * pcshrink() gives back a page when memory runs out.
+// * readi() calls pcread() for regular files. writei() still
+//   writes through the log, and calls pcupdate() to keep any
+//   cached copy current. itrunc() calls pcinval().
+//
+// The caller must hold the inode's lock, which keeps two
+// callers from filling the same page at once. pcache.lock
+// protects the hash table, the LRU list and ref.
+//
+// The cache is limited to a quarter of the free memory at boot.
+// Pages that are also mapped by some process are not evicted,
+// so every mapping of a file page shares one physical page.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "file.h"
+#include "pagecache.h"
+#include "defs.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define NPCHASH 127
+#define PCHASH(dev, inum, index) (((dev) * 31 + (inum) * 17 + (index)) % NPCHASH)
+
+struct {
+  struct spinlock lock;
+  int npages;                  // pages with data
+  int limit;                   // most pages to hold
+  struct page *free;           // unused descriptors
+  struct page *hash[NPCHASH];
+
+  // Linked list of cached pages, through prev/next.
+  // head.next is most recent, head.prev is least.
+  struct page head;
+} pcache;
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  pcache.limit = kfreepages() / 4;
+}
+
+// remove pg from the hash table and LRU list.
+// pcache.lock must be held.
+static void
+unlink(struct page *pg)
+{
+  struct page **pp;
+
+  for(pp = &pcache.hash[PCHASH(pg->dev, pg->inum, pg->index)]; *pp != pg; pp = &(*pp)->hnext)
+    ;
+  *pp = pg->hnext;
+  pg->next->prev = pg->prev;
+  pg->prev->next = pg->next;
+}
+
+// find a descriptor with a data page for a new cache entry,
+// allocating one while under the limit and evicting the least
+// recently used unmapped page otherwise. Returns 0 if none.
+// pcache.lock must be held.
+static struct page*
+pcalloc(void)
+{
+  struct page *pg;
+  char *mem;
+
+  if(pcache.npages < pcache.limit){
+    if(pcache.free == 0){
+      // carve a page into descriptors.
+      if((mem = kalloc()) == 0)
+        goto evict;
+      for(pg = (struct page*)mem; pg + 1 <= (struct page*)(mem + PGSIZE); pg++){
+        pg->next = pcache.free;
+        pcache.free = pg;
+      }
+    }
+    if((mem = kalloc()) == 0)
+      goto evict;
+    pg = pcache.free;
+    pcache.free = pg->next;
+    pg->data = mem;
+    pcache.npages++;
+    return pg;
+  }
+
+evict:
+  for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev){
+    if(pg->ref == 0 && krefcount(pg->data) == 1){
+      unlink(pg);
+      return pg;
+    }
+  }
+  return 0;
+}
+
+// read page index of ip into mem, zeroing past the end.
+static void
+fill(struct inode *ip, uint index, char *mem)
+{
+  struct buf *bp;
+  uint bn, addr, nblocks;
+
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  for(int i = 0; i < PGSIZE / BSIZE; i++){
+    bn = index * (PGSIZE / BSIZE) + i;
+    if(bn >= nblocks || (addr = bmap(ip, bn)) == 0){
+      memset(mem + i*BSIZE, 0, BSIZE);
+      continue;
+    }
+    bp = bread(ip->dev, addr);
+    memmove(mem + i*BSIZE, bp->data, BSIZE);
+    brelsecold(bp);
+  }
+}
+
+// Return page index of ip with a reference, reading it
+// in if it isn't cached, or 0 if no memory is available.
+// Caller must hold ip->lock.
+struct page*
+pcget(struct inode *ip, uint index)
+{
+  struct page *pg;
+  int h = PCHASH(ip->dev, ip->inum, index);
+
+  acquire(&pcache.lock);
+  for(pg = pcache.hash[h]; pg; pg = pg->hnext){
+    if(pg->dev == ip->dev && pg->inum == ip->inum && pg->index == index){
+      pg->ref++;
+      pg->next->prev = pg->prev;
+      pg->prev->next = pg->next;
+      goto found;
+    }
+  }
+  if((pg = pcalloc()) == 0){
+    release(&pcache.lock);
+    return 0;
+  }
+  pg->dev = ip->dev;
+  pg->inum = ip->inum;
+  pg->index = index;
+  pg->ref = 1;
+  release(&pcache.lock);
+
+  // out of the hash table, no one else can find it while
+  // it fills; ip->lock keeps others from adding a twin.
+  fill(ip, index, pg->data);
+
+  acquire(&pcache.lock);
+  pg->hnext = pcache.hash[h];
+  pcache.hash[h] = pg;
+
+found:
+  pg->next = pcache.head.next;
+  pg->prev = &pcache.head;
+  pcache.head.next->prev = pg;
+  pcache.head.next = pg;
+  release(&pcache.lock);
+  return pg;
+}
+
+// Return page index of ip with a reference if it is
+// cached, or 0 without reading it in.
+// Caller must hold ip->lock.
+struct page*
+pcfind(struct inode *ip, uint index)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.hash[PCHASH(ip->dev, ip->inum, index)]; pg; pg = pg->hnext){
+    if(pg->dev == ip->dev && pg->inum == ip->inum && pg->index == index){
+      pg->ref++;
+      break;
+    }
+  }
+  release(&pcache.lock);
+  return pg;
+}
+
+// Drop a reference from pcget() or pcfind().
+void
+pcput(struct page *pg)
+{
+  acquire(&pcache.lock);
+  if(pg->ref < 1)
+    panic("pcput");
+  pg->ref--;
+  release(&pcache.lock);
+}
+
+// Read n bytes of ip at off through the cache, as readi()
+// does. off and n must be within the file. A page there is
+// no memory to cache is read through bcache instead.
+// Caller must hold ip->lock.
+int
+pcread(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  uint tot, m;
+  int r;
+  struct page *pg;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((pg = pcget(ip, off/PGSIZE)) == 0){
+      if((r = readblocks(ip, user_dst, dst, off, m)) < 0)
+        return -1;
+      if(r != m)
+        return tot + r;
+      continue;
+    }
+    if(either_copyout(user_dst, dst, pg->data + (off % PGSIZE), m) == -1) {
+      pcput(pg);
+      tot = -1;
+      break;
+    }
+    pcput(pg);
+  }
+  return tot;
+}
+
+// Copy n bytes just written to ip at off, all within one
+// page, into the cached page if there is one.
+// Caller must hold ip->lock.
+void
+pcupdate(struct inode *ip, uint off, char *src, uint n)
+{
+  struct page *pg;
+  uint index = off / PGSIZE;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.hash[PCHASH(ip->dev, ip->inum, index)]; pg; pg = pg->hnext){
+    if(pg->dev == ip->dev && pg->inum == ip->inum && pg->index == index){
+      memmove(pg->data + off % PGSIZE, src, n);
+      break;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Free the least recently used page that no one is using
+// or has mapped, for swapout().
+// Returns 0, or -1 if there is none.
+int
+pcshrink(void)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev){
+    if(pg->ref == 0 && krefcount(pg->data) == 1){
+      unlink(pg);
+      kfree(pg->data);
+      pg->next = pcache.free;
+      pcache.free = pg;
+      pcache.npages--;
+      release(&pcache.lock);
+      return 0;
+    }
+  }
+  release(&pcache.lock);
+  return -1;
+}
+
+// Drop all cached pages of ip, after it is truncated.
+// Processes that have them mapped keep their copies.
+// Caller must hold ip->lock.
+void
+pcinval(struct inode *ip)
+{
+  struct page *pg, *next;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.head.next; pg != &pcache.head; pg = next){
+    next = pg->next;
+    if(pg->dev != ip->dev || pg->inum != ip->inum)
+      continue;
+    if(pg->ref != 0)
+      panic("pcinval: busy");
+    unlink(pg);
+    kfree(pg->data);
+    pg->next = pcache.free;
+    pcache.free = pg;
+    pcache.npages--;
+  }
+  release(&pcache.lock);
+}
+
+// Describe the page cache, for /proc/mem.
+int
+pcprint(char *buf, int sz)
+{
+  int n;
+
+  acquire(&pcache.lock);
+  n = snprintf(buf, sz, "pcpages %d\npclimit %d\n", pcache.npages, pcache.limit);
+  release(&pcache.lock);
+  return n;
+}
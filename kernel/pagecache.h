@@ -0,0 +1,11 @@
+// A page of file data in the page cache.
+struct page {
+  uint dev;
+  uint inum;
+  uint index;          // page number within the file
+  int ref;             // pcget() callers using it
+  char *data;          // the PGSIZE bytes, from kalloc()
+  struct page *hnext;  // hash chain
+  struct page *prev;   // LRU list
+  struct page *next;
+};
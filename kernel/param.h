@@ -1,12 +1,14 @@
-#ifdef LAB_FS
-#define NPROC        10  // maximum number of processes
-#else
-#define NPROC        64  // maximum number of processes (speedsup bigfile)
-#endif
 #define NCPU          8  // maximum number of CPUs
+#define NKSTACK   16384  // kernel stack slots: most processes at once
+#define NPROCKEEP    64  // exited procs kept for reuse, not freed
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NTHREAD       8  // threads per process, including the first
+#define NSHM         16  // shared memory segments per system
+#define NSHMAT        4  // segments attached per process
+#define SHMMAXPAGES  64  // max pages in a shared memory segment
+#define NVMA         16  // mmap()ed regions per process
+#define NEXECSEG      4  // loadable ELF segments per program
+#define NPIN          4  // uvmprefault() ranges pinned per system call
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
@@ -19,10 +21,16 @@
 #ifdef LAB_LOCK
 #define FSSIZE       10000  // size of file system in blocks
 #else
-#define FSSIZE       2000   // size of file system in blocks
+#define FSSIZE       4000   // size of file system in blocks; room for the .sym files
 #endif
 #endif
+#define SWAPBLOCKS   32768 // swap space after the file system, in blocks
 #define MAXPATH      128   // maximum file path name
+#define TIMEBASE     10000000 // qemu virt time CSR frequency (Hz)
+#ifndef HZ
+#define HZ           10    // scheduler ticks per second
+#endif
+#define TICKCYCLES   (TIMEBASE/HZ) // time CSR cycles per tick
 
 #ifdef LAB_UTIL
 #define USERSTACK    2     // user stack pages
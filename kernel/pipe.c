@@ -7,6 +7,7 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
 
 #define PIPESIZE 512
 
@@ -19,6 +20,14 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+struct kmem_cache *pipecache;
+
+void
+pipeinit(void)
+{
+  pipecache = kmem_cache_create("pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,7 +37,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = kmem_cache_alloc(pipecache)) == 0)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
@@ -47,7 +56,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    kmem_cache_free(pipecache, pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -66,52 +75,85 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pollwakeup();
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    kmem_cache_free(pipecache, pi);
   } else
     release(&pi->lock);
 }
 
+// write n bytes from user address addr, waiting for room;
+// if nonblock, write what fits, and return -1 if nothing does.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, uint64 addr, int n, int nonblock)
 {
-  int i = 0;
+  int i = 0, end, stop = 0;
   struct proc *pr = myproc();
 
-  acquire(&pi->lock);
-  while(i < n){
-    if(pi->readopen == 0 || killed(pr)){
-      release(&pi->lock);
-      return -1;
+  while(i < n && !stop){
+    // copyin() can't fault with pi->lock held, so fault in
+    // up to a pipe's worth first. a page that can't be
+    // mapped ends the write there.
+    end = n - i < PIPESIZE ? n - i : PIPESIZE;
+    if((end = uvmprefault(addr + i, end, 0)) == 0){
+      if(i == 0)
+        i = -1;
+      break;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
-    } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+    end += i;
+    acquire(&pi->lock);
+    while(i < end && !stop){
+      if(pi->readopen == 0 || killed(pr)){
+        release(&pi->lock);
+        return -1;
+      }
+      if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+        if(nonblock){
+          if(i == 0)
+            i = -1;
+          stop = 1;
+          break;
+        }
+        wakeup(&pi->nread);
+        pollwakeup();
+        sleep(&pi->nwrite, &pi->lock);
+      } else {
+        char ch;
+        if(copyin(pr->pagetable, &ch, addr + i, 1) == -1){
+          stop = 1;
+          break;
+        }
+        pi->data[pi->nwrite++ % PIPESIZE] = ch;
+        i++;
+      }
     }
+    wakeup(&pi->nread);
+    pollwakeup();
+    release(&pi->lock);
   }
-  wakeup(&pi->nread);
-  release(&pi->lock);
 
   return i;
 }
 
+// read up to n bytes to user address addr, waiting for some;
+// if nonblock, return -1 instead of waiting.
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, uint64 addr, int n, int nonblock)
 {
   int i;
   struct proc *pr = myproc();
   char ch;
 
+  // at most a pipe's worth is read; fault in just that much,
+  // since copyout() can't fault with pi->lock held.
+  if(n > PIPESIZE)
+    n = PIPESIZE;
+  if(n > 0 && (n = uvmprefault(addr, n, 1)) == 0)
+    return -1;
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
-    if(killed(pr)){
+    if(killed(pr) || nonblock){
       release(&pi->lock);
       return -1;
     }
@@ -125,6 +167,27 @@ piperead(struct pipe *pi, uint64 addr, int n)
       break;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  pollwakeup();
   release(&pi->lock);
   return i;
 }
+
+// Which of POLLIN, POLLOUT, POLLHUP and POLLERR hold for pi,
+// for either end.
+int
+pipepoll(struct pipe *pi)
+{
+  int r = 0;
+
+  acquire(&pi->lock);
+  if(pi->nread != pi->nwrite || !pi->writeopen)
+    r |= POLLIN;
+  if(!pi->writeopen)
+    r |= POLLHUP;
+  if(pi->nwrite != pi->nread + PIPESIZE || !pi->readopen)
+    r |= POLLOUT;
+  if(!pi->readopen)
+    r |= POLLERR;
+  release(&pi->lock);
+  return r;
+}
@@ -0,0 +1,112 @@
+// Waiting for any of several files.
+//
+// A sleeping process waits on one channel, so poll() waits on a
+// single one shared by all pollers: anything that may make a
+// file ready, such as a pipe read or write, the console
+// receiving a line, or a poll() deadline passing, calls
+// pollwakeup(). It counts a sequence number, and wakes the
+// pollers if there are any; a poller checks its files, then
+// sleeps only if the sequence number hasn't moved meanwhile.
+// A wakeup meant for other files just costs a poller a look.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "poll.h"
+#include "defs.h"
+
+struct {
+  struct spinlock lock;
+  uint seq;          // pollwakeup() calls
+  int nsleep;        // pollers asleep
+} polls;
+
+void
+pollinit(void)
+{
+  initlock(&polls.lock, "poll");
+}
+
+// Something may have become ready.
+void
+pollwakeup(void)
+{
+  acquire(&polls.lock);
+  polls.seq++;
+  if(polls.nsleep)
+    wakeup(&polls);
+  release(&polls.lock);
+}
+
+// fill in the revents of the n pollfds in pfd.
+// returns the number with any.
+static int
+pollcheck(struct pollfd *pfd, int n)
+{
+  struct file *f;
+  int i, ready = 0;
+
+  for(i = 0; i < n; i++){
+    pfd[i].revents = 0;
+    if(pfd[i].fd < 0)
+      continue;
+    if((f = fdfile(pfd[i].fd)) == 0){
+      pfd[i].revents = POLLNVAL;
+    } else {
+      pfd[i].revents = filepoll(f) & (pfd[i].events | POLLERR | POLLHUP);
+      fileclose(f);
+    }
+    if(pfd[i].revents)
+      ready++;
+  }
+  return ready;
+}
+
+// Wait until one of the n struct pollfds at user address addr
+// is ready, or for timeout milliseconds; forever if timeout is
+// negative. Returns the number ready, 0 on a timeout, or -1.
+int
+poll(uint64 addr, int n, int timeout)
+{
+  struct proc *p = myproc();
+  struct pollfd pfd[NOFILE];
+  uint64 deadline;
+  uint seq;
+  int ready;
+
+  if(n < 0 || n > NOFILE)
+    return -1;
+  if(copyin(p->pagetable, (char*)pfd, addr, n * sizeof(pfd[0])) < 0)
+    return -1;
+  deadline = timeout < 0 ? ~0ULL : r_time() + (uint64)timeout * (TIMEBASE/1000);
+
+  for(;;){
+    acquire(&polls.lock);
+    seq = polls.seq;
+    release(&polls.lock);
+
+    if((ready = pollcheck(pfd, n)) > 0 || r_time() >= deadline)
+      break;
+    if(killed(p))
+      return -1;
+    if(deadline != ~0ULL)
+      timeralarm(deadline);
+
+    acquire(&polls.lock);
+    if(polls.seq == seq){
+      polls.nsleep++;
+      sleep(&polls, &polls.lock);
+      polls.nsleep--;
+    }
+    release(&polls.lock);
+  }
+
+  if(copyout(p->pagetable, addr, (char*)pfd, n * sizeof(pfd[0])) < 0)
+    return -1;
+  return ready;
+}
@@ -0,0 +1,16 @@
+// poll() events, for struct pollfd.
+#define POLLIN    0x01   // read won't block
+#define POLLOUT   0x04   // write won't block
+#define POLLERR   0x08   // write would fail: no reader
+#define POLLHUP   0x10   // no writer: read returns 0 at the end
+#define POLLNVAL  0x20   // fd isn't open
+
+struct pollfd {
+  int fd;
+  short events;      // POLLIN and POLLOUT to wait for
+  short revents;     // those ready, and POLLERR, POLLHUP, POLLNVAL
+};
+
+// fcntl() commands.
+#define F_GETFL   1      // returns the open mode, O_RDONLY etc. and O_NONBLOCK
+#define F_SETFL   2      // sets O_NONBLOCK from arg
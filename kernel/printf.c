@@ -1,6 +1,12 @@
 //
 // formatted console output -- printf, panic.
 //
+// each CPU formats into a buffer of its own, with interrupts
+// off, and adds it to the kernel log (klog.c) whole, which
+// passes it on to the console; so CPUs don't take turns, and
+// the output of one printf() isn't interleaved with another's.
+// panic() writes straight to the uart.
+//
 
 #include <stdarg.h>
 
@@ -14,17 +20,54 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "klog.h"
 
 volatile int panicked = 0;
 
-// lock to avoid interleaving concurrent printf's.
+#define PRBUF KLOGTEXT
+
 static struct {
-  struct spinlock lock;
-  int locking;
+  int sync;          // panicking: bypass the buffers and the log
+  struct {
+    char buf[PRBUF];
+    int n;
+    int midline;     // last output didn't end a line
+  } cpu[NCPU];
 } pr;
 
 static char digits[] = "0123456789abcdef";
 
+// send this CPU's buffered output to the log.
+// interrupts must be off.
+static void
+prflush(void)
+{
+  int id = cpuid();
+  int n = pr.cpu[id].n;
+
+  if(n == 0)
+    return;
+  if(pr.sync){
+    for(int i = 0; i < n; i++)
+      uartputc_sync(pr.cpu[id].buf[i]);
+  } else {
+    klogwrite(pr.cpu[id].buf, n, !pr.cpu[id].midline);
+  }
+  pr.cpu[id].midline = pr.cpu[id].buf[n-1] != '\n';
+  pr.cpu[id].n = 0;
+}
+
+// interrupts must be off.
+static void
+prputc(int c)
+{
+  int id = cpuid();
+
+  if(pr.cpu[id].n == PRBUF)
+    prflush();
+  pr.cpu[id].buf[pr.cpu[id].n++] = c;
+}
+
 static void
 printint(long long xx, int base, int sign)
 {
@@ -46,17 +89,17 @@ printint(long long xx, int base, int sign)
     buf[i++] = '-';
 
   while(--i >= 0)
-    consputc(buf[i]);
+    prputc(buf[i]);
 }
 
 static void
 printptr(uint64 x)
 {
   int i;
-  consputc('0');
-  consputc('x');
+  prputc('0');
+  prputc('x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    prputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the console.
@@ -64,17 +107,15 @@ int
 printf(char *fmt, ...)
 {
   va_list ap;
-  int i, cx, c0, c1, c2, locking;
+  int i, cx, c0, c1, c2;
   char *s;
 
-  locking = pr.locking;
-  if(locking)
-    acquire(&pr.lock);
+  push_off();
 
   va_start(ap, fmt);
   for(i = 0; (cx = fmt[i] & 0xff) != 0; i++){
     if(cx != '%'){
-      consputc(cx);
+      prputc(cx);
       continue;
     }
     i++;
@@ -112,15 +153,15 @@ printf(char *fmt, ...)
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        prputc(*s);
     } else if(c0 == '%'){
-      consputc('%');
+      prputc('%');
     } else if(c0 == 0){
       break;
     } else {
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c0);
+      prputc('%');
+      prputc(c0);
     }
 
 #if 0
@@ -138,23 +179,23 @@ printf(char *fmt, ...)
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        prputc(*s);
       break;
     case '%':
-      consputc('%');
+      prputc('%');
       break;
     default:
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c);
+      prputc('%');
+      prputc(c);
       break;
     }
 #endif
   }
   va_end(ap);
 
-  if(locking)
-    release(&pr.lock);
+  prflush();
+  pop_off();
 
   return 0;
 }
@@ -162,17 +203,15 @@ printf(char *fmt, ...)
 void
 panic(char *s)
 {
-  pr.locking = 0;
+  // get out what was printed before, then write directly.
+  push_off();
+  uartflush_sync();
+  klogflush_sync();
+  pr.sync = 1;
+  pop_off();
   printf("panic: ");
   printf("%s\n", s);
   panicked = 1; // freeze uart output from other CPUs
   for(;;)
     ;
 }
-
-void
-printfinit(void)
-{
-  initlock(&pr.lock, "pr");
-  pr.locking = 1;
-}
@@ -6,20 +6,83 @@
 #include "proc.h"
 #include "defs.h"
 #include "kalloc.h"
+#include "sched.h"
+#include "syscall.h"
+#include "sysstat.h"
+#include "time.h"
+#include "futex.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// every struct proc, newest first. an exited proc is marked
+// UNUSED and put on unusedprocs for reuse; beyond NPROCKEEP of
+// those, it is unlinked and freed by procreclaim() once no hart
+// can still be looking at it. so the list may be walked without
+// a lock, but only with interrupts off, and a proc pointer found
+// there stays valid only until they are turned back on.
+struct proc *allproc;
+int nallproc;
 
 struct proc *initproc;
 
+// pid_lock protects nextpid, the pid hash table, unusedprocs,
+// changes to allproc, the procs waiting to be freed, and the
+// kernel stack slots.
 int nextpid = 1;
 struct spinlock pid_lock;
+#define NPIDHASH 64
+struct proc *pidhash[NPIDHASH];
+struct proc *unusedprocs;
+int nunused;
+struct proc *limbo;     // unlinked; freed after the next grace period
+struct proc *freeing;   // unlinked; freed once every hart is quiet
+uint64 kstackmap[NKSTACK/64];  // KSTACK() slots in use, a bit each
+
+struct kmem_cache *proccache;
+struct kmem_cache *sysstatcache;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void wakeidle(int n);
+static void placeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
+extern pagetable_t kernel_pagetable; // vm.c
+
+// SCHED_FAIR load weight for each nice value, NICE_MIN first.
+// each step is about 1.25x, so one nice level is roughly a 10%
+// change in CPU share against a competing process.
+static const int niceweight[NICE_MAX - NICE_MIN + 1] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+#define NICE_0_WEIGHT 1024
+
+// smallest vruntime among runnable SCHED_FAIR processes, as last
+// seen by a scheduler() scan. only ever increases. used to place
+// woken processes so a long sleep doesn't buy a long CPU burst.
+// every CPU's scheduler() raises it, so it is read with
+// getminvruntime() and raised with a compare-and-swap.
+uint64 minvruntime;
+
+static uint64
+getminvruntime(void)
+{
+  return __atomic_load_n(&minvruntime, __ATOMIC_RELAXED);
+}
+
+// how far behind minvruntime a woken process may start, in timer
+// cycles. lets interactive processes run ahead of CPU hogs.
+#define SCHED_WAKEUP_CREDIT 1000000
+
+// serializes futex() value checks against wakeups.
+struct spinlock futex_lock;
 
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
@@ -27,36 +90,15 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl)
-{
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
-}
-
 // initialize the proc table.
 void
 procinit(void)
 {
-  struct proc *p;
-  
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc));
-  }
+  initlock(&futex_lock, "futex");
+  proccache = kmem_cache_create("proc", sizeof(struct proc));
+  sysstatcache = kmem_cache_create("sysstat", NSYSCALL * sizeof(struct sysstat));
 }
 
 // Must be called with interrupts disabled,
@@ -90,41 +132,173 @@ myproc(void)
   return p;
 }
 
-int
-allocpid()
+// Give p a pid and enter it in the pid hash table.
+static void
+allocpid(struct proc *p)
 {
-  int pid;
-  
   acquire(&pid_lock);
-  pid = nextpid;
+  p->pid = nextpid;
   nextpid = nextpid + 1;
+  p->pidnext = pidhash[p->pid % NPIDHASH];
+  pidhash[p->pid % NPIDHASH] = p;
   release(&pid_lock);
-
-  return pid;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
-static struct proc*
-allocproc(void)
+// Return the proc with the given pid, locked, or 0 if none.
+struct proc*
+findproc(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  // interrupts stay off until p is locked, so that
+  // procreclaim() can't free it in between.
+  push_off();
+  acquire(&pid_lock);
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+  release(&pid_lock);
+  if(p){
     acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
+    if(p->pid != pid){
+      // exited meanwhile.
       release(&p->lock);
+      p = 0;
     }
   }
+  pop_off();
+  return p;
+}
+
+// Map a page at a free KSTACK() slot for p's kernel stack,
+// leaving the guard page below it unmapped.
+// Returns 0, or -1 if out of slots or memory.
+static int
+kstackalloc(struct proc *p)
+{
+  char *mem;
+  int i;
+
+  if((mem = kalloc()) == 0)
+    return -1;
+  acquire(&pid_lock);
+  for(i = 0; i < NKSTACK; i += 64)
+    if(kstackmap[i/64] != ~0ULL)
+      break;
+  if(i < NKSTACK)
+    while(kstackmap[i/64] & (1ULL << (i%64)))
+      i++;
+  if(i == NKSTACK ||
+     mappages(kernel_pagetable, KSTACK(i), PGSIZE, (uint64)mem, PTE_R | PTE_W, PGSIZE) < 0){
+    release(&pid_lock);
+    kfree(mem);
+    return -1;
+  }
+  kstackmap[i/64] |= 1ULL << (i%64);
+  release(&pid_lock);
+  p->kstack = KSTACK(i);
   return 0;
+}
+
+// Unmap and free p's kernel stack. A hart may still hold the
+// old mapping in its TLB, but flushes it before switching to
+// whatever proc gets the slot next.
+static void
+kstackfree(struct proc *p)
+{
+  int i = (TRAMPOLINE - p->kstack) / (2*PGSIZE) - 1;
+  pte_t *pte;
+  uint64 pa;
+
+  acquire(&pid_lock);
+  if((pte = walk(kernel_pagetable, p->kstack, 0)) == 0 || (*pte & PTE_V) == 0)
+    panic("kstackfree");
+  pa = PTE2PA(*pte);
+  *pte = 0;
+  kstackmap[i/64] &= ~(1ULL << (i%64));
+  release(&pid_lock);
+  kfree((void*)pa);
+}
+
+// Take an UNUSED proc for reuse, or make a new one with
+// its own kernel stack.
+// Returns 0 if out of memory.
+static struct proc*
+newproc(void)
+{
+  struct proc *p;
+  struct sysstat *st;
+
+  acquire(&pid_lock);
+  if((p = unusedprocs) != 0){
+    unusedprocs = p->nextunused;
+    nunused--;
+  }
+  release(&pid_lock);
+  if(p)
+    return p;
+
+  if((p = kmem_cache_alloc(proccache)) == 0)
+    return 0;
+  if((st = kmem_cache_alloc(sysstatcache)) == 0){
+    kmem_cache_free(proccache, p);
+    return 0;
+  }
+  memset(p, 0, sizeof(*p));
+  if(kstackalloc(p) < 0){
+    kmem_cache_free(sysstatcache, st);
+    kmem_cache_free(proccache, p);
+    return 0;
+  }
+  initlock(&p->lock, "proc");
+  initlock(&p->vmlock, "vmlock");
+  p->state = UNUSED;
+  p->sysstat = st;
+
+  // scans of allproc must see p whole.
+  acquire(&pid_lock);
+  p->next = allproc;
+  __sync_synchronize();
+  allproc = p;
+  nallproc++;
+  release(&pid_lock);
+  return p;
+}
 
-found:
-  p->pid = allocpid();
+// Find or make an UNUSED proc, initialize state required
+// to run in the kernel, and return with p->lock held.
+// If a memory allocation fails, return 0.
+static struct proc*
+allocproc(void)
+{
+  struct proc *p;
+
+  if((p = newproc()) == 0)
+    return 0;
+  acquire(&p->lock);
+  allocpid(p);
   p->state = USED;
+  p->policy = SCHED_FAIR;
+  p->nice = 0;
+  p->rtprio = 0;
+  p->vruntime = getminvruntime();
+  p->cputime = 0;
+  p->lastrun = 0;
+  p->cycles = 0;
+  p->instret = 0;
+  p->leader = p;
+  p->tslot = 0;
+  p->tslots = 0;
+  p->shrinking = 0;
+  p->children = 0;
+  p->sibling = 0;
+  p->ustack = 0;
+  p->ring = 0;
+  p->ringsize = 0;
+  p->ringbusy = 0;
+  p->npins = 0;
+  p->ofile = p->files;
+  memset(p->sysstat, 0, NSYSCALL * sizeof(struct sysstat));
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -132,6 +306,18 @@ found:
     release(&p->lock);
     return 0;
   }
+  p->trapframe->fastcalls = FASTCALLS;
+
+  // and the page user code reads its pid and the clock from.
+  if((p->usyscall = (struct usyscall *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  p->usyscall->pid = p->pid;
+  p->usyscall->pad = 0;
+  p->usyscall->timebase = TIMEBASE;
+  p->usyscall->tickcycles = TICKCYCLES;
 
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
@@ -156,20 +342,123 @@ found:
 static void
 freeproc(struct proc *p)
 {
+  struct proc *l = p->leader;
+  struct proc **pp;
+
+  if(p->pagetable && l != p){
+    // a thread: just take its trapframe out of the shared page table.
+    acquire(&l->vmlock);
+    uvmunmap(p->pagetable, THREADFRAME(p->tslot), 1, 0);
+    l->tslots &= ~(1 << p->tslot);
+    p->tslot = 0;
+    release(&l->vmlock);
+  } else if(p->pagetable){
+    proc_freepagetable(p->pagetable, p->sz);
+  }
+  p->pagetable = 0;
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
+  if(p->usyscall)
+    kfree((void*)p->usyscall);
+  p->usyscall = 0;
+  p->leader = 0;
+  p->ustack = 0;
+  p->ofile = 0;
   p->sz = 0;
-  p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->policy = SCHED_FAIR;
+  p->nice = 0;
+  p->rtprio = 0;
+  p->vruntime = 0;
+  p->cputime = 0;
   p->state = UNUSED;
+
+  acquire(&pid_lock);
+  for(pp = &pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  p->pid = 0;
+  if(nunused < NPROCKEEP){
+    p->nextunused = unusedprocs;
+    unusedprocs = p;
+    nunused++;
+  } else {
+    // a walk of allproc may be at p, and go on to p->next.
+    for(pp = &allproc; *pp != p; pp = &(*pp)->next)
+      ;
+    *pp = p->next;
+    nallproc--;
+    p->nextunused = limbo;
+    limbo = p;
+  }
+  release(&pid_lock);
+}
+
+// Free the procs unlinked from allproc before the current grace
+// period began, once every hart has been through the top of
+// scheduler()'s loop since then, and begin the next. Walks of
+// allproc keep interrupts off, so they can't be preempted and
+// can't span the top of the loop; there, this hart holds no
+// pointer from a walk begun before.
+static void
+procreclaim(struct cpu *c)
+{
+  struct proc *p, *done = 0;
+  int i, begun = 0;
+
+  c->quiet = 1;
+  __sync_synchronize();
+  if(freeing == 0 && limbo == 0)
+    return;
+
+  acquire(&pid_lock);
+  for(i = 0; i < NCPU; i++)
+    if(cpus[i].up && !cpus[i].quiet)
+      break;
+  if(freeing == 0 || i == NCPU){
+    done = freeing;
+    freeing = limbo;
+    limbo = 0;
+    if(freeing){
+      for(i = 0; i < NCPU; i++)
+        cpus[i].quiet = 0;
+      c->quiet = 1;
+      begun = 1;
+    }
+  }
+  release(&pid_lock);
+
+  // idle harts may otherwise sleep through the grace period.
+  if(begun)
+    wakeidle(NCPU);
+
+  while((p = done) != 0){
+    done = p->nextunused;
+    kstackfree(p);
+    kmem_cache_free(sysstatcache, p->sysstat);
+    kmem_cache_free(proccache, p);
+  }
+}
+
+// Take p off its parent's list of children.
+// Caller must hold wait_lock.
+static void
+unlinkchild(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &p->parent->children; *pp != p; pp = &(*pp)->sibling)
+    ;
+  *pp = p->sibling;
+  p->sibling = 0;
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -203,6 +492,15 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the data page for ulib, readable by the user.
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(p->usyscall), PTE_R | PTE_U, PGSIZE) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 // Free a process's page table, and free the
@@ -212,6 +510,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, USYSCALL, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -260,7 +559,22 @@ int
 growproc(int n)
 {
   struct proc *p = myproc();
-  uint oldsz = p->sz;
+  struct proc *l = p->leader;
+
+  // uvmalloc() can't swap out pages with vmlock held.
+  if(n > 0)
+    swapreserve(PGROUNDUP(n) / PGSIZE);
+
+  // threads share the page table, so they use the leader's size.
+  acquire(&l->vmlock);
+  // another thread's shrink unmaps above l->sz with vmlock
+  // released; map nothing there until it is done.
+  while(l->shrinking){
+    release(&l->vmlock);
+    yield();
+    acquire(&l->vmlock);
+  }
+  uint oldsz = l->sz;
   uint new_sz = oldsz + n;
 
   printf("growproc: oldsz = %d, new_sz = %d, n = %d\n", oldsz, new_sz, n);
@@ -268,20 +582,58 @@ growproc(int n)
   if (n > 0) {
     if (uvmalloc(p->pagetable, oldsz, new_sz, PTE_W | PTE_X | PTE_R | PTE_U) == 0) {
       printf("uvmalloc failed\n");
+      release(&l->vmlock);
       return -1;
     }
   } else if (n < 0) {
-    if (uvmdealloc(p->pagetable, oldsz, new_sz) == 0) {
-      printf("uvmdealloc failed\n");
-      return -1;
-    }
+    // free the pages only once other threads' TLBs can't
+    // reach them; that means waiting, so not under vmlock.
+    l->sz = new_sz;
+    l->shrinking = 1;
+    release(&l->vmlock);
+    uvmunmapshared(l, PGROUNDUP(new_sz), PGROUNDUP(oldsz));
+    acquire(&l->vmlock);
+    l->shrinking = 0;
   }
 
-  p->sz = new_sz;
+  l->sz = new_sz;
+  release(&l->vmlock);
   switchuvm(p);
   return 0;
 }
 
+// Make np, a new child of p's process, runnable. The child
+// inherits p's scheduling class, and starts where p is in
+// virtual time so creating it buys no CPU.
+static void
+startchild(struct proc *np, struct proc *p)
+{
+  int policy, pnice, rtprio;
+  uint64 vruntime;
+
+  acquire(&wait_lock);
+  np->parent = p->leader;
+  np->sibling = np->parent->children;
+  np->parent->children = np;
+  release(&wait_lock);
+
+  acquire(&p->lock);
+  policy = p->policy;
+  pnice = p->nice;
+  rtprio = p->rtprio;
+  vruntime = p->vruntime;
+  release(&p->lock);
+
+  acquire(&np->lock);
+  np->policy = policy;
+  np->nice = pnice;
+  np->rtprio = rtprio;
+  np->vruntime = vruntime;
+  np->state = RUNNABLE;
+  release(&np->lock);
+  wakeidle(1);
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int
@@ -291,18 +643,38 @@ fork(void)
   struct proc *np;
   struct proc *p = myproc();
 
+  // uvmcopy() can't swap out pages with np->lock held.
+  swapreserve(p->leader->sz / PGSIZE);
+
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
   }
 
-  // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // Copy user memory from parent to child. The leader's
+  // vmlock keeps other threads from freeing pages meanwhile.
+  acquire(&p->leader->vmlock);
+  if(uvmcopy(p->pagetable, np->pagetable, p->leader->sz) < 0){
+    release(&p->leader->vmlock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->sz = p->leader->sz;
+  release(&p->leader->vmlock);
+
+  // attach the same shared memory segments and files.
+  if(shmfork(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  if(mmapfork(p, np) < 0){
+    shmexit(np);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -312,25 +684,222 @@ fork(void)
 
   // increment reference counts on open file descriptors.
   for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
+    np->ofile[i] = fdfile(i);
   np->cwd = idup(p->cwd);
 
+  // pages of the program not yet faulted in come from the same file.
+  if(p->leader->exe)
+    np->exe = idup(p->leader->exe);
+  memmove(np->seg, p->leader->seg, sizeof(np->seg));
+
+  // the child's copy of the ring is at the same address.
+  np->ring = p->leader->ring;
+  np->ringsize = p->leader->ringsize;
+
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
 
   release(&np->lock);
 
+  startchild(np, p);
+
+  return pid;
+}
+
+// Create a new thread in the caller's process, running fn(arg)
+// on the user stack whose top is stack. The thread shares the
+// leader's page table, size and open files, and has its own
+// trapframe, kernel stack and cwd reference.
+// Returns the new thread's pid, or -1.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int slot, tid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+
+  // the thread runs in l's page table, not the one allocproc made.
+  proc_freepagetable(np->pagetable, 0);
+  np->pagetable = 0;
+  kfree((void*)np->usyscall);
+  np->usyscall = 0;
+
+  // find a free trapframe slot in l's page table.
+  acquire(&l->vmlock);
+  for(slot = 1; slot < NTHREAD; slot++)
+    if((l->tslots & (1 << slot)) == 0)
+      break;
+  if(slot == NTHREAD ||
+     mappages(l->pagetable, THREADFRAME(slot), PGSIZE,
+              (uint64)np->trapframe, PTE_R | PTE_W, PGSIZE) < 0){
+    release(&l->vmlock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->leader = l;
+  np->tslot = slot;
+  l->tslots |= 1 << slot;
+  // threads share l's USYSCALL page but have pids of their own.
+  l->usyscall->pid = 0;
+  np->pagetable = l->pagetable;
+  release(&l->vmlock);
+
+  // start at fn(arg) on the new stack, with the caller's
+  // other registers.
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  np->ustack = stack;
+
+  np->ofile = l->files;
+  np->cwd = idup(p->cwd);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  tid = np->pid;
+
+  release(&np->lock);
+
+  startchild(np, p);
+
+  return tid;
+}
+
+// Wait for thread tid of the caller's process to exit, copy
+// the stack it was created with to addr, and return tid.
+// Returns -1 if tid is not another thread of this process.
+int
+join(int tid, uint64 addr)
+{
+  struct proc *pp;
+  int found;
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+
+  if(tid == p->pid)
+    return -1;
+  if(addr != 0 && uvmprefault(addr, sizeof(uint64), 1) < sizeof(uint64))
+    return -1;
+
   acquire(&wait_lock);
-  np->parent = p;
+
+  for(;;){
+    found = 0;
+    for(pp = l->children; pp; pp = pp->sibling){
+      acquire(&pp->lock);
+      if(pp->pid == tid && pp->leader == l){
+        found = 1;
+        if(pp->state == ZOMBIE){
+          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->ustack,
+                                  sizeof(pp->ustack)) < 0) {
+            release(&pp->lock);
+            release(&wait_lock);
+            return -1;
+          }
+          unlinkchild(pp);
+          freeproc(pp);
+          release(&pp->lock);
+          release(&wait_lock);
+          return tid;
+        }
+      }
+      release(&pp->lock);
+    }
+
+    if(!found || killed(p)){
+      release(&wait_lock);
+      return -1;
+    }
+
+    // exiting threads wake their leader.
+    sleep(l, &wait_lock);
+  }
+}
+
+// Kill every other thread of leader l, wait for them to exit,
+// and free them. l calls this before it tears down or replaces
+// the address space and files they share.
+void
+killthreads(struct proc *l)
+{
+  struct proc *pp, *next;
+  int n;
+
+  acquire(&wait_lock);
+  for(;;){
+    n = 0;
+    for(pp = l->children; pp; pp = next){
+      next = pp->sibling;
+      acquire(&pp->lock);
+      if(pp->leader == l){
+        if(pp->state == ZOMBIE){
+          unlinkchild(pp);
+          freeproc(pp);
+        } else {
+          pp->killed = 1;
+          if(pp->state == SLEEPING){
+            placeproc(pp);
+            pp->state = RUNNABLE;
+          }
+          n++;
+        }
+      }
+      release(&pp->lock);
+    }
+    if(n == 0)
+      break;
+    sleep(l, &wait_lock);
+  }
   release(&wait_lock);
+}
 
-  acquire(&np->lock);
-  np->state = RUNNABLE;
-  release(&np->lock);
+// Block while the user word at addr holds val (FUTEX_WAIT), or
+// wake at most val threads blocked on addr, all if val < 0, and
+// return how many (FUTEX_WAKE). Waiters sleep on the word's physical address, so
+// processes sharing the page also share the futex. FUTEX_WAIT
+// returns -1 at once if the word has already changed.
+int
+futex(uint64 addr, int op, int val)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+  volatile int *word;
 
-  return pid;
+  if(addr % sizeof(int))
+    return -1;
+  // fault in a word on a page not yet touched; the pin also
+  // keeps the page, and so the channel, in place while asleep.
+  if(uvmprefault(addr, sizeof(int), 0) < sizeof(int) ||
+     (pa = walkaddr(p->pagetable, PGROUNDDOWN(addr))) == 0)
+    return -1;
+  word = (volatile int *)(pa + addr % PGSIZE);
+
+  acquire(&futex_lock);
+  if(op == FUTEX_WAIT){
+    // checking under futex_lock means a FUTEX_WAKE issued after
+    // the word changes cannot slip in before we sleep.
+    if(*word != val || killed(p)){
+      release(&futex_lock);
+      return -1;
+    }
+    sleep((void *)word, &futex_lock);
+    release(&futex_lock);
+    return 0;
+  } else if(op == FUTEX_WAKE){
+    int n = wakeupn((void *)word, val);
+    release(&futex_lock);
+    return n;
+  }
+  release(&futex_lock);
+  return -1;
 }
 
 // Pass p's abandoned children to init.
@@ -340,12 +909,15 @@ reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  if(p->children == 0)
+    return;
+  while((pp = p->children) != 0){
+    p->children = pp->sibling;
+    pp->parent = initproc;
+    pp->sibling = initproc->children;
+    initproc->children = pp;
   }
+  wakeup(initproc);
 }
 
 // Exit the current process.  Does not return.
@@ -359,19 +931,32 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
+  // A thread leaves the shared files to its leader, which
+  // stops the other threads before closing them.
+  if(p->leader == p){
+    killthreads(p);
+    shmexit(p);
+    mmapexit(p);
+
+    // Close all open files.
+    for(int fd = 0; fd < NOFILE; fd++){
+      if(p->ofile[fd]){
+        struct file *f = p->ofile[fd];
+        // clear first: fileprint() trusts what it finds in ofile.
+        p->ofile[fd] = 0;
+        fileclose(f);
+      }
     }
   }
 
   begin_op();
   iput(p->cwd);
+  if(p->leader == p && p->exe)
+    iput(p->exe);
   end_op();
   p->cwd = 0;
+  if(p->leader == p)
+    p->exe = 0;
 
   acquire(&wait_lock);
 
@@ -395,20 +980,26 @@ exit(int status)
 
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
+// Children belong to the leader, whichever thread forked them;
+// threads are reaped by join() instead.
 int
 wait(uint64 addr)
 {
   struct proc *pp;
   int havekids, pid;
   struct proc *p = myproc();
+  struct proc *l = p->leader;
+
+  if(addr != 0 && uvmprefault(addr, sizeof(int), 1) < sizeof(int))
+    return -1;
 
   acquire(&wait_lock);
 
   for(;;){
     // Scan through table looking for exited children.
     havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
+    for(pp = l->children; pp; pp = pp->sibling){
+      if(pp->leader == pp){
         // make sure the child isn't still in exit() or swtch().
         acquire(&pp->lock);
 
@@ -422,6 +1013,7 @@ wait(uint64 addr)
             release(&wait_lock);
             return -1;
           }
+          unlinkchild(pp);
           freeproc(pp);
           release(&pp->lock);
           release(&wait_lock);
@@ -438,53 +1030,136 @@ wait(uint64 addr)
     }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(l, &wait_lock);  //DOC: wait-sleep
+  }
+}
+
+// Is a better to run than b?  SCHED_RT beats SCHED_FAIR; within
+// SCHED_RT the higher rtprio wins, and equal priorities take turns
+// by whichever ran least recently; within SCHED_FAIR the smaller
+// vruntime wins.
+static int
+betterproc(struct proc *a, struct proc *b)
+{
+  if(b == 0)
+    return 1;
+  if(a->policy != b->policy)
+    return a->policy == SCHED_RT;
+  if(a->policy == SCHED_RT){
+    if(a->rtprio != b->rtprio)
+      return a->rtprio > b->rtprio;
+    return a->lastrun < b->lastrun;
   }
+  return a->vruntime < b->vruntime;
+}
+
+// Charge p for the time since it was switched in.
+// SCHED_FAIR processes accumulate vruntime inversely
+// to their weight, so a nice process falls behind faster.
+// p->lock must be held.
+static void
+chargeproc(struct proc *p)
+{
+  uint64 delta = r_time() - p->lastrun;
+
+  p->cputime += delta;
+  p->cycles += r_cycle() - p->lastcycle;
+  p->instret += r_instret() - p->lastinstret;
+  if(p->policy == SCHED_FAIR)
+    p->vruntime += delta * NICE_0_WEIGHT / niceweight[p->nice - NICE_MIN];
 }
 
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose the best RUNNABLE process: the highest priority
+//    SCHED_RT process if any, else the SCHED_FAIR process
+//    with the least vruntime.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
 void
 scheduler(void)
 {
-  struct proc *p;
+  struct proc *p, *best;
   struct cpu *c = mycpu();
+  uint64 minv, v;
 
   c->proc = 0;
+  c->up = 1;
   for(;;){
     // The most recent process to run may have had interrupts
     // turned off; enable them to avoid a deadlock if all
     // processes are waiting.
     intr_on();
 
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
+    procreclaim(c);
+
+    // until it picks a process, wakeidle() may interrupt this
+    // CPU, so a process made RUNNABLE after the scan below has
+    // passed it still wakes the wfi.
+    c->idle = 1;
+
+    // Find the best candidate. Locks are taken one at a time,
+    // so the choice may be stale by the time we act on it;
+    // it is re-checked below.
+    best = 0;
+    minv = 0;
+    for(p = allproc; p; p = p->next) {
       acquire(&p->lock);
       if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found = 1;
+        if(p->policy == SCHED_FAIR && (minv == 0 || p->vruntime < minv))
+          minv = p->vruntime;
+        if(betterproc(p, best))
+          best = p;
       }
       release(&p->lock);
     }
-    if(found == 0) {
-      // nothing to run; stop running on this core until an interrupt.
-      intr_on();
+    while(minv > (v = getminvruntime()))
+      if(__sync_bool_compare_and_swap(&minvruntime, v, minv))
+        break;
+
+    if(best == 0) {
+      // nothing to run; zero pages for kalloc_zeroed() while
+      // idle, looking for work again after each one.
+      if(kzeroidle())
+        continue;
+
+      // still nothing; stop running on this core until an
+      // interrupt, and skip timer ticks until the next deadline.
+      // wfi returns for an interrupt requested with them off,
+      // which the top of the loop then takes.
+      intr_off();
+      timerset();
       asm volatile("wfi");
+      continue;
     }
+
+    p = best;
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      c->idle = 0;
+      p->lastrun = r_time();
+      p->lastcycle = r_cycle();
+      p->lastinstret = r_instret();
+      c->proc = p;
+      c->tickdue = r_time() + TICKCYCLES;
+      timerset();
+      // p's kernel stack slot may have been remapped since this
+      // hart last used it (see kstackfree()).
+      sfence_vma();
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      chargeproc(p);
+      c->proc = 0;
+    }
+    release(&p->lock);
   }
 }
 
@@ -581,24 +1256,104 @@ sleep(void *chan, struct spinlock *lk)
   acquire(lk);
 }
 
+// A process waking from sleep keeps at most SCHED_WAKEUP_CREDIT
+// of virtual time in hand, so it runs soon but cannot monopolize
+// the CPU to catch up on time spent asleep.
+// p->lock must be held.
+static void
+placeproc(struct proc *p)
+{
+  uint64 minv = getminvruntime();
+
+  if(p->policy == SCHED_FAIR && minv > SCHED_WAKEUP_CREDIT &&
+     p->vruntime < minv - SCHED_WAKEUP_CREDIT)
+    p->vruntime = minv - SCHED_WAKEUP_CREDIT;
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
+{
+  wakeupn(chan, -1);
+}
+
+// Wake up at most n processes sleeping on chan, or all of
+// them if n < 0, and return how many were woken.
+// Must be called without any p->lock.
+int
+wakeupn(void *chan, int n)
 {
   struct proc *p;
+  int woken = 0;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  push_off();  // walking allproc
+  for(p = allproc; p && woken != n; p = p->next) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
+        placeproc(p);
         p->state = RUNNABLE;
+        woken++;
       }
       release(&p->lock);
     }
   }
+  pop_off();
+  if(woken)
+    wakeidle(woken);
+  return woken;
+}
+
+// Interrupt up to n CPUs that are looking for work in
+// scheduler(), after making processes RUNNABLE, so that
+// an idle one runs them now rather than at its next timer
+// interrupt, which may be a long way off.
+static void
+wakeidle(int n)
+{
+  int i;
+
+  __sync_synchronize();
+  for(i = 0; i < NCPU && n > 0; i++){
+    if(cpus[i].idle){
+      sendipi(i);
+      n--;
+    }
+  }
+}
+// Copy the calling thread's counters, including its current
+// run, to user address addr. Returns 0, or -1.
+int
+getcounters(uint64 addr)
+{
+  struct proc *p = myproc();
+  struct counters c;
+
+  // the CSRs are per hart; don't move while reading them.
+  push_off();
+  c.cycles = p->cycles + r_cycle() - p->lastcycle;
+  c.instret = p->instret + r_instret() - p->lastinstret;
+  c.time = p->cputime + r_time() - p->lastrun;
+  pop_off();
+  return copyout(p->pagetable, addr, (char*)&c, sizeof(c));
+}
+
+// Copy the first n of process pid's system call statistics
+// to st. Returns 0, or -1 if there is no such process.
+int
+procsysstat(int pid, struct sysstat *st, int n)
+{
+  struct proc *p;
+
+  if(pid <= 0 || (p = findproc(pid)) == 0)
+    return -1;
+  memmove(st, p->sysstat, n * sizeof(*st));
+  release(&p->lock);
+  return 0;
 }
 
+
 // Kill the process with the given pid.
 // The victim won't exit until it tries to return
 // to user space (see usertrap() in trap.c).
@@ -607,20 +1362,75 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
+  if(pid <= 0 || (p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    placeproc(p);
+    p->state = RUNNABLE;
     release(&p->lock);
+    wakeidle(1);
+    return 0;
   }
-  return -1;
+  release(&p->lock);
+  return 0;
+}
+
+// Set the scheduling class of the process with the given pid,
+// or of the caller if pid is 0. prio is the nice value for
+// SCHED_FAIR and the real-time priority for SCHED_RT.
+// Returns 0, or -1 if there is no such process or prio is
+// out of range.
+int
+setpriority(int pid, int policy, int prio)
+{
+  struct proc *p;
+
+  if(policy == SCHED_FAIR){
+    if(prio < NICE_MIN || prio > NICE_MAX)
+      return -1;
+  } else if(policy == SCHED_RT){
+    if(prio < RTPRIO_MIN || prio > RTPRIO_MAX)
+      return -1;
+  } else {
+    return -1;
+  }
+
+  if(pid == 0)
+    pid = myproc()->pid;
+
+  if(pid < 0 || (p = findproc(pid)) == 0)
+    return -1;
+  if(policy == SCHED_FAIR){
+    if(p->policy != SCHED_FAIR)
+      p->vruntime = getminvruntime();
+    p->nice = prio;
+  } else {
+    p->rtprio = prio;
+  }
+  p->policy = policy;
+  release(&p->lock);
+  return 0;
+}
+
+// Add incr to the caller's nice value, clamped to
+// NICE_MIN..NICE_MAX. Returns the new nice value.
+int
+nice(int incr)
+{
+  struct proc *p = myproc();
+  int n;
+
+  acquire(&p->lock);
+  n = p->nice + incr;
+  if(n < NICE_MIN)
+    n = NICE_MIN;
+  if(n > NICE_MAX)
+    n = NICE_MAX;
+  p->nice = n;
+  release(&p->lock);
+  return n;
 }
 
 void
@@ -690,7 +1500,7 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = allproc; p; p = p->next){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -698,10 +1508,92 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    if(p->policy == SCHED_RT)
+      printf(" rt=%d", p->rtprio);
+    else
+      printf(" nice=%d", p->nice);
+    printf(" cpu=%ldms", p->cputime / (TIMEBASE / 1000));
     printf("\n");
   }
 }
 
+// Describe each process and thread, one line each, for
+// /proc/procs: pid, parent pid, leader pid, state, name,
+// memory size, open files, page-table pages, resident and
+// swapped-out pages (of leaders), and run time in ms.
+// The page counts are 0 for a process running on another hart,
+// whose exec() could free the page table being counted.
+// Returns the length.
+int
+procprint(char *buf, int sz)
+{
+  static char *states[] = {
+  [UNUSED]    "unused",
+  [USED]      "used",
+  [SLEEPING]  "sleeping",
+  [RUNNABLE]  "runnable",
+  [RUNNING]   "running",
+  [ZOMBIE]    "zombie"
+  };
+  struct proc *p, *l;
+  uint64 pt[3];
+  int off, fd, nfile, ppid;
+
+  off = snprintf(buf, sz, "pid ppid tgid state name size files ptpages resident swapped cpums\n");
+  push_off();  // walking allproc
+  for(p = allproc; p && off < sz-1; p = p->next){
+    acquire(&wait_lock);
+    acquire(&p->lock);
+    ppid = p->parent ? p->parent->pid : 0;
+    release(&wait_lock);
+    if(p->state == UNUSED){
+      release(&p->lock);
+      continue;
+    }
+    l = p->leader;
+    nfile = 0;
+    for(fd = 0; fd < NOFILE; fd++)
+      if(p->ofile[fd])
+        nfile++;
+    pt[0] = pt[1] = pt[2] = 0;
+    // p->lock keeps a sleeping or runnable p from running, as
+    // in evict(); the caller's own process can't be in exec().
+    if(l == p && p->pagetable &&
+       (p->state == SLEEPING || p->state == RUNNABLE || p == myproc()->leader)){
+      acquire(&p->vmlock);
+      uvmcount(p->pagetable, pt);
+      release(&p->vmlock);
+    }
+    off += snprintf(buf+off, sz-off, "%d %d %d %s %s %ld %d %ld %ld %ld %ld\n",
+                    p->pid, ppid, l->pid, states[p->state],
+                    p->name, l->sz, nfile, pt[0], pt[1], pt[2],
+                    p->cputime / (TIMEBASE / 1000));
+    release(&p->lock);
+  }
+  pop_off();
+  return off;
+}
+
+// Describe the open files of each process, for /proc/files.
+// Returns the length.
+int
+procfilesprint(char *buf, int sz)
+{
+  struct proc *p;
+  int off;
+
+  off = snprintf(buf, sz, "pid fd type ref mode\n");
+  push_off();  // walking allproc
+  for(p = allproc; p && off < sz-1; p = p->next){
+    acquire(&p->lock);
+    if(p->state != UNUSED && p->state != ZOMBIE && p->leader == p)
+      off += fileprint(p->pid, p->ofile, buf+off, sz-off);
+    release(&p->lock);
+  }
+  pop_off();
+  return off;
+}
+
 void
 switchuvm(struct proc *p)
 {
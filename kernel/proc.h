@@ -24,6 +24,11 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 tickdue;             // When to preempt proc, in time CSR cycles.
+  int up;                     // Has entered scheduler().
+  int quiet;                  // Through scheduler()'s loop since freeing began.
+  int idle;                   // Looking for work; wakeidle() interrupts it.
+  uint64 nipi;                // Software interrupts taken, for tlbshootdown().
 };
 
 extern struct cpu cpus[NCPU];
@@ -39,7 +44,10 @@ extern struct cpu cpus[NCPU];
 // trapframe, switch to the user page table, and enter user space.
 // the trapframe includes callee-saved user registers like s0-s11 because the
 // return-to-user path via usertrapret() doesn't return through
-// the entire kernel call stack.
+// the entire kernel call stack. the fast path for the system
+// calls in fastcalls does return through it, to uservec, and
+// saves only what a system call reads or the user's call to
+// its stub must keep.
 struct trapframe {
   /*   0 */ uint64 kernel_satp;   // kernel page table
   /*   8 */ uint64 kernel_sp;     // top of process's kernel stack
@@ -77,6 +85,40 @@ struct trapframe {
   /* 264 */ uint64 t4;
   /* 272 */ uint64 t5;
   /* 280 */ uint64 t6;
+  /* 288 */ uint64 kernel_fasttrap; // usertrap_fast()
+  /* 296 */ uint64 fastcalls;     // system calls for uservec's fast path, a bit each
+};
+
+// what usertrap_fast() returns to trampoline.S, in a0 and a1:
+// the user page table and trapframe address, as for userret.
+struct fastret {
+  uint64 satp;
+  uint64 trapframe;
+};
+
+// A region of a file mapped by mmap().
+struct vma {
+  uint64 addr;                 // Page-aligned start, or 0 if unused
+  uint64 len;                  // Length in bytes, a multiple of PGSIZE
+  int prot;                    // PROT_ bits
+  int flags;                   // MAP_SHARED or MAP_PRIVATE
+  struct file *f;              // Mapped file, holding a reference
+  uint off;                    // File offset of addr
+};
+
+// A range uvmprefault() faulted in for a system call.
+struct pin {
+  uint64 va;
+  uint64 len;
+};
+
+// A loadable segment of a process's program, for execfault().
+struct execseg {
+  uint64 va;                   // Page-aligned start
+  uint64 memsz;                // Size in memory; 0 ends the list
+  uint64 filesz;               // Bytes read from the file, the rest zero
+  uint off;                    // File offset of va
+  int perm;                    // PTE_ bits to map it with
 };
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
@@ -91,17 +133,56 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int policy;                  // SCHED_FAIR or SCHED_RT
+  int nice;                    // SCHED_FAIR weight, NICE_MIN..NICE_MAX
+  int rtprio;                  // SCHED_RT priority, higher runs first
+  uint64 vruntime;             // Weighted run time, for SCHED_FAIR
+  uint64 cputime;              // Total time run, in timer cycles
+  uint64 lastrun;              // r_time() when last switched in
+  uint64 cycles;               // Cycles run, as for cputime
+  uint64 instret;              // Instructions retired while running
+  uint64 lastcycle;            // r_cycle() when last switched in
+  uint64 lastinstret;          // r_instret() when last switched in
+
+  // wait_lock must be held when using these:
+  struct proc *parent;         // Parent process; the creator's leader, for threads
+  struct proc *children;       // Processes and threads whose parent this is
+  struct proc *sibling;        // Next child of the same parent
 
-  // wait_lock must be held when using this:
-  struct proc *parent;         // Parent process
+  // pid_lock must be held when using these:
+  struct proc *next;           // allproc list; left as is when unlinked
+  struct proc *pidnext;        // Pid hash chain
+  struct proc *nextunused;     // unusedprocs list
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
+  uint64 sz;                   // Size of process memory (bytes); threads use the leader's
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  struct usyscall *usyscall;   // data page mapped read-only at USYSCALL
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
+  struct file **ofile;         // Open files; files[], or the leader's
+  struct file *files[NOFILE];  // Open file table, unless a thread
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct sysstat *sysstat;     // Per-system-call counts, NSYSCALL of them
+  struct pin pins[NPIN];       // uvmprefault()ed ranges that swapout() leaves
+  int npins;                   //   alone until the system call returns; all if > NPIN
+
+  // threads from clone() share their leader's pagetable, sz and
+  // open files. set at creation; tslot is freed under leader->vmlock.
+  struct proc *leader;         // First thread of this process; p itself if not a thread
+  int tslot;                   // Trapframe is mapped at THREADFRAME(tslot)
+  uint tslots;                 // Leader only: trapframe slots its threads use; vmlock protects
+  uint64 ustack;               // User stack passed to clone()
+
+  struct spinlock vmlock;      // Leader only: serializes changes to a shared address space
+  struct shmseg *shm[NSHMAT];  // Leader only: attached segments; vmlock protects
+  struct vma vma[NVMA];        // Leader only: mmap()ed files; vmlock protects
+  struct inode *exe;           // Leader only: program file; set by exec
+  struct execseg seg[NEXECSEG]; // Leader only: its segments, faulted in lazily
+  int shrinking;               // Leader only: growproc() is unmapping above sz; vmlock protects
+  uint64 ring;                 // Leader only: ring from ringsetup(), or 0
+  uint ringsize;               // Leader only: its entries
+  int ringbusy;                // Leader only: a thread is in ringenter(); ringlock protects
 };
@@ -0,0 +1,81 @@
+//
+// The proc device: read-only files describing kernel state,
+// which init makes in /proc (see procfs.h).
+//
+// Each read formats the whole file afresh and returns the
+// part at the file offset, so a file read in pieces may mix
+// two snapshots. The text is plain "name value" lines or a
+// header line and one line per item.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "procfs.h"
+#include "defs.h"
+
+#define BUFSZ (4*PGSIZE)
+
+static struct {
+  struct sleeplock lock;   // protects buf
+  char buf[BUFSZ];
+} procfs;
+
+// format file minor into procfs.buf; returns the length.
+static int
+procfsfill(int minor)
+{
+  char *b = procfs.buf;
+  int n;
+
+  switch(minor){
+  case PROC_PROCS:
+    return procprint(b, BUFSZ);
+  case PROC_FILES:
+    return procfilesprint(b, BUFSZ);
+  case PROC_MEM:
+    n = kmemprint(b, BUFSZ);
+    n += pcprint(b+n, BUFSZ-n);
+    n += swapprint(b+n, BUFSZ-n);
+    n += slabprint(b+n, BUFSZ-n);
+    return n;
+  case PROC_BCACHE:
+    return bcacheprint(b, BUFSZ);
+  case PROC_LOG:
+    return logprint(b, BUFSZ);
+  case PROC_LOCKS:
+    return statslock(b, BUFSZ);
+  }
+  return -1;
+}
+
+int
+procfsread(int minor, uint64 dst, uint off, int n)
+{
+  int len;
+
+  acquiresleep(&procfs.lock);
+  if((len = procfsfill(minor)) < 0){
+    releasesleep(&procfs.lock);
+    return -1;
+  }
+  if(off >= len)
+    n = 0;
+  else if(n > len - off)
+    n = len - off;
+  if(n > 0 && either_copyout(1, dst, procfs.buf + off, n) < 0)
+    n = -1;
+  releasesleep(&procfs.lock);
+  return n;
+}
+
+void
+procfsinit(void)
+{
+  initsleeplock(&procfs.lock, "procfs");
+  devsw[PROCFS].pread = procfsread;
+}
@@ -0,0 +1,8 @@
+// Files of the proc device, by minor number. init makes
+// device nodes for them in /proc.
+#define PROC_PROCS   1  // processes and threads
+#define PROC_FILES   2  // open files of each process
+#define PROC_MEM     3  // page allocator, page cache, swap, slabs
+#define PROC_BCACHE  4  // buffer cache
+#define PROC_LOG     5  // file system log
+#define PROC_LOCKS   6  // spinlock contention, as in /statistics
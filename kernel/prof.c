@@ -0,0 +1,121 @@
+// Sampling profiler.
+//
+// While profiling is on, each timer interrupt records the
+// interrupted pc, whether it was in user or kernel mode, and
+// the running process in a ring of samples belonging to the
+// CPU that took it. Timer interrupts come at profhz rather than
+// at every tick on CPUs that are running a process, without
+// changing how often those processes are preempted; idle CPUs
+// are left asleep and aren't sampled.
+//
+// profctl() turns profiling on or off; profread() drains the
+// rings. A full ring drops new samples and counts them.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "prof.h"
+#include "defs.h"
+
+#define NPROFSAMP 512       // samples held per CPU
+#define MAXPROFHZ 10000
+
+struct profbuf {
+  struct spinlock lock;
+  uint head;                // oldest sample
+  uint n;                   // samples held
+  uint64 lost;              // samples dropped while full
+  struct profsample s[NPROFSAMP];
+};
+
+static struct profbuf profbuf[NCPU];
+
+// samples per second, or 0 if not profiling. read by
+// timerset() without a lock; a stale value costs a sample.
+int profhz;
+
+void
+profinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&profbuf[i].lock, "prof");
+}
+
+// Record a sample. Called from clockintr() with interrupts off.
+void
+profsample(uint64 pc, int user)
+{
+  struct profbuf *b = &profbuf[cpuid()];
+  struct proc *p = myproc();
+  struct profsample *s;
+
+  acquire(&b->lock);
+  if(b->n == NPROFSAMP){
+    b->lost++;
+  } else {
+    s = &b->s[(b->head + b->n) % NPROFSAMP];
+    s->pc = pc;
+    s->user = user;
+    s->pid = p ? p->pid : 0;
+    safestrcpy(s->name, p ? p->name : "-", sizeof(s->name));
+    b->n++;
+  }
+  release(&b->lock);
+}
+
+// Sample hz times a second, discarding any samples not yet
+// read, or stop if hz is 0. Returns the number of samples
+// dropped for lack of room since profiling last started,
+// or -1 if hz is out of range.
+int
+profctl(int hz)
+{
+  struct profbuf *b;
+  uint64 lost = 0;
+
+  if(hz < 0 || hz > MAXPROFHZ)
+    return -1;
+  for(b = profbuf; b < &profbuf[NCPU]; b++){
+    acquire(&b->lock);
+    lost += b->lost;
+    if(hz){
+      b->head = b->n = 0;
+      b->lost = 0;
+    }
+    release(&b->lock);
+  }
+  profhz = hz;
+  return lost;
+}
+
+// Copy up to n samples, oldest first for each CPU, to the
+// struct profsample array at user address addr.
+// Returns the number copied, or -1.
+int
+profread(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct profbuf *b;
+  struct profsample s[8];   // bounce buffer: no copyout under b->lock
+  int i, m, got = 0;
+
+  for(b = profbuf; b < &profbuf[NCPU]; b++){
+    for(;;){
+      acquire(&b->lock);
+      for(m = 0; m < NELEM(s) && m < b->n && got + m < n; m++)
+        s[m] = b->s[(b->head + m) % NPROFSAMP];
+      b->head = (b->head + m) % NPROFSAMP;
+      b->n -= m;
+      release(&b->lock);
+      if(m == 0)
+        break;
+      for(i = 0; i < m; i++, got++)
+        if(copyout(p->pagetable, addr + got*sizeof(s[0]), (char*)&s[i], sizeof(s[0])) < 0)
+          return -1;
+    }
+  }
+  return got;
+}
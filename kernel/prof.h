@@ -0,0 +1,7 @@
+// A profiler sample, from profread().
+struct profsample {
+  uint64 pc;         // interrupted program counter
+  int pid;           // running process, or 0 if none
+  int user;          // 1 if pc is a user address of pid
+  char name[16];     // pid's program name
+};
@@ -0,0 +1,38 @@
+// A submission/completion ring for batching system calls,
+// shared by user code and the kernel through ringsetup() and
+// ringenter(). The user process fills sq[] entries and
+// advances sqtail; ringenter() carries out entries from sqhead,
+// posting a completion for each at cqtail. The user consumes
+// completions from cqhead. Indices run freely and are taken
+// modulo size, a power of two.
+//
+// The ring lives in user memory: a struct ring, then size
+// sqes, then size cqes.
+
+#define RINGMAX 256   // most entries in a ring
+
+struct sqe {
+  int op;            // SYS_read, SYS_write, SYS_open, SYS_close or SYS_fstat
+  int pad;
+  uint64 arg[3];     // its arguments, as for the system call
+  uint64 data;       // passed back in the completion
+};
+
+struct cqe {
+  uint64 data;       // from the sqe
+  int res;           // what the system call returned
+  int pad;
+};
+
+struct ring {
+  uint sqhead;       // written by the kernel
+  uint sqtail;       // written by the user
+  uint cqhead;       // written by the user
+  uint cqtail;       // written by the kernel
+  uint size;
+  uint pad;
+};
+
+#define RINGSQ(r)     ((struct sqe*)((r) + 1))
+#define RINGCQ(r)     ((struct cqe*)(RINGSQ(r) + (r)->size))
+#define RINGBYTES(n)  (sizeof(struct ring) + (n)*(sizeof(struct sqe) + sizeof(struct cqe)))
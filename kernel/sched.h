@@ -0,0 +1,8 @@
+// Scheduling classes, for setpriority().
+#define SCHED_FAIR  0   // weighted virtual-runtime fair share (default)
+#define SCHED_RT    1   // fixed priority, always runs before SCHED_FAIR
+
+#define NICE_MIN    -20 // highest SCHED_FAIR weight
+#define NICE_MAX     19 // lowest SCHED_FAIR weight
+#define RTPRIO_MIN    1
+#define RTPRIO_MAX   99 // highest SCHED_RT priority
@@ -0,0 +1,255 @@
+// Shared memory segments.
+//
+// A segment is a set of physical pages that any number of
+// processes can attach to their address spaces; writes by one
+// are seen directly by the others. The segment holds one
+// reference on each of its pages and every attachment holds
+// another, so a page lives until the segment is removed with
+// shmrm() and the last process has detached it.
+//
+// Attachments belong to a process's leader thread and are
+// protected by its vmlock. Attachment i is always mapped at
+// SHMWINDOW(i).
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "shm.h"
+
+struct shmseg {
+  int used;
+  int key;
+  int npages;
+  int nattach;     // number of page tables it is mapped in
+  int removed;     // shmrm() called; free at nattach == 0
+  uint64 pages[SHMMAXPAGES];
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shm;
+
+void
+shminit(void)
+{
+  initlock(&shm.lock, "shm");
+}
+
+// free s's pages and slot.
+// shm.lock must be held.
+static void
+shmfree(struct shmseg *s)
+{
+  for(int i = 0; i < s->npages; i++)
+    kfree((void*)s->pages[i]);
+  s->used = 0;
+}
+
+// drop an attachment of s.
+static void
+shmput(struct shmseg *s)
+{
+  acquire(&shm.lock);
+  if(--s->nattach == 0 && s->removed)
+    shmfree(s);
+  release(&shm.lock);
+}
+
+// map s into pagetable at va, taking a reference on
+// each page. Returns 0, or -1 with nothing mapped.
+static int
+shmmap(pagetable_t pagetable, uint64 va, struct shmseg *s)
+{
+  int i;
+
+  for(i = 0; i < s->npages; i++){
+    if(mappages(pagetable, va + i*PGSIZE, PGSIZE, s->pages[i],
+                PTE_R | PTE_W | PTE_U, PGSIZE) < 0){
+      uvmunmap(pagetable, va, i, 1);
+      return -1;
+    }
+    krefinc((void*)s->pages[i]);
+  }
+  acquire(&shm.lock);
+  s->nattach++;
+  release(&shm.lock);
+  return 0;
+}
+
+// Return the id of the segment with the given key, creating
+// it with at least size bytes of zeroed memory if there is
+// none. SHM_PRIVATE always creates a new segment.
+// Returns -1 if size is too large or no memory is left.
+int
+shmget(int key, int size)
+{
+  struct shmseg *s;
+  int npages = PGROUNDUP((uint64)size) / PGSIZE;
+  char *mem;
+
+  if(size <= 0 || npages > SHMMAXPAGES)
+    return -1;
+
+  acquire(&shm.lock);
+  if(key != SHM_PRIVATE){
+    for(s = shm.seg; s < &shm.seg[NSHM]; s++){
+      if(s->used && !s->removed && s->key == key){
+        release(&shm.lock);
+        return s->npages >= npages ? s - shm.seg : -1;
+      }
+    }
+  }
+  for(s = shm.seg; s < &shm.seg[NSHM]; s++)
+    if(!s->used)
+      break;
+  if(s == &shm.seg[NSHM]){
+    release(&shm.lock);
+    return -1;
+  }
+  s->used = 1;
+  s->key = key;
+  s->nattach = 0;
+  s->removed = 0;
+  for(s->npages = 0; s->npages < npages; s->npages++){
+    if((mem = kalloc_zeroed()) == 0){
+      shmfree(s);
+      release(&shm.lock);
+      return -1;
+    }
+    s->pages[s->npages] = (uint64)mem;
+  }
+  release(&shm.lock);
+  return s - shm.seg;
+}
+
+// Attach segment id to the caller's address space.
+// Returns the address it is mapped at, or -1.
+uint64
+shmat(int id)
+{
+  struct proc *l = myproc()->leader;
+  struct shmseg *s;
+  int i;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  s = &shm.seg[id];
+
+  acquire(&l->vmlock);
+  for(i = 0; i < NSHMAT; i++)
+    if(l->shm[i] == 0)
+      break;
+  acquire(&shm.lock);
+  if(i == NSHMAT || !s->used || s->removed){
+    release(&shm.lock);
+    release(&l->vmlock);
+    return -1;
+  }
+  // hold an attachment while mapping so shmrm() can't free it.
+  s->nattach++;
+  release(&shm.lock);
+
+  if(shmmap(l->pagetable, SHMWINDOW(i), s) < 0){
+    shmput(s);
+    release(&l->vmlock);
+    return -1;
+  }
+  shmput(s);
+  l->shm[i] = s;
+  release(&l->vmlock);
+  return SHMWINDOW(i);
+}
+
+// Detach the segment attached at addr.
+int
+shmdt(uint64 addr)
+{
+  struct proc *l = myproc()->leader;
+  struct shmseg *s;
+
+  acquire(&l->vmlock);
+  for(int i = 0; i < NSHMAT; i++){
+    if((s = l->shm[i]) != 0 && SHMWINDOW(i) == addr){
+      // the segment's own references keep the pages
+      // until shmput(), after the other threads' TLBs
+      // are flushed.
+      uvmunmap(l->pagetable, addr, s->npages, 1);
+      l->shm[i] = 0;
+      release(&l->vmlock);
+      tlbshootdown(l);
+      shmput(s);
+      return 0;
+    }
+  }
+  release(&l->vmlock);
+  return -1;
+}
+
+// Remove segment id once no process has it attached.
+// Its key can be used for a new segment at once.
+int
+shmrm(int id)
+{
+  struct shmseg *s;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  s = &shm.seg[id];
+
+  acquire(&shm.lock);
+  if(!s->used || s->removed){
+    release(&shm.lock);
+    return -1;
+  }
+  s->removed = 1;
+  if(s->nattach == 0)
+    shmfree(s);
+  release(&shm.lock);
+  return 0;
+}
+
+// Give np, a new child of p, the same attachments
+// as p's process. Returns 0, or -1 with none attached.
+int
+shmfork(struct proc *p, struct proc *np)
+{
+  struct proc *l = p->leader;
+  struct shmseg *s;
+  int i;
+
+  acquire(&l->vmlock);
+  for(i = 0; i < NSHMAT; i++){
+    if((s = l->shm[i]) == 0)
+      continue;
+    if(shmmap(np->pagetable, SHMWINDOW(i), s) < 0){
+      release(&l->vmlock);
+      shmexit(np);
+      return -1;
+    }
+    np->shm[i] = s;
+  }
+  release(&l->vmlock);
+  return 0;
+}
+
+// Detach all of p's segments, before its page
+// table is freed or replaced. p must be a leader
+// with no other threads.
+void
+shmexit(struct proc *p)
+{
+  struct shmseg *s;
+
+  for(int i = 0; i < NSHMAT; i++){
+    if((s = p->shm[i]) != 0){
+      uvmunmap(p->pagetable, SHMWINDOW(i), s->npages, 1);
+      p->shm[i] = 0;
+      shmput(s);
+    }
+  }
+}
@@ -0,0 +1,2 @@
+// shmget() key that always creates a new segment.
+#define SHM_PRIVATE 0
@@ -0,0 +1,234 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one size, carved from
+// pages of kalloc() memory called slabs. Each slab begins with
+// a struct slab header; the object free list of a slab is linked
+// through the first word of each free object. An object's slab
+// is found by rounding its address down to the page.
+//
+// Each CPU has a magazine of recently freed objects per cache,
+// used without taking the cache's lock. When a magazine is
+// empty it is refilled with half a magazine from the slabs; when
+// full, half of it goes back. A slab whose objects are all free
+// is returned to kalloc().
+//
+// Interface:
+// * kmem_cache_create() makes a cache; caches are never destroyed.
+// * kmem_cache_alloc() returns an uninitialized object, or 0.
+// * kmem_cache_free() gives one back.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+
+#define NKCACHE 8    // caches in the system
+#define MAGSIZE 16   // objects in a per-CPU magazine
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *prev;   // cache's list of slabs with free objects
+  struct slab *next;
+  int nfree;
+  void *free;          // free objects
+};
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct kmem_cache {
+  char *name;
+  struct spinlock lock;
+  uint size;           // object size, rounded up to 8
+  int perslab;         // objects in a slab
+  int nslabs;
+  int nobjs;           // objects allocated, magazines included
+  struct slab *partial; // slabs with free objects
+  struct magazine mag[NCPU];
+};
+
+struct {
+  struct spinlock lock;
+  int n;
+  struct kmem_cache cache[NKCACHE];
+} kcaches;
+
+void
+slabinit(void)
+{
+  initlock(&kcaches.lock, "kcaches");
+}
+
+// Make a cache of objects of size bytes.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+  uint hdr = (sizeof(struct slab) + 7) & ~7;
+
+  size = (size + 7) & ~7;
+  if(size < sizeof(void*) || size > PGSIZE - hdr)
+    panic("kmem_cache_create: size");
+
+  acquire(&kcaches.lock);
+  if(kcaches.n == NKCACHE)
+    panic("kmem_cache_create: too many");
+  c = &kcaches.cache[kcaches.n++];
+  release(&kcaches.lock);
+
+  c->name = name;
+  initlock(&c->lock, name);
+  c->size = size;
+  c->perslab = (PGSIZE - hdr) / size;
+  return c;
+}
+
+// take s off c->partial.
+// c->lock must be held.
+static void
+unlinkslab(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// put s on c->partial.
+// c->lock must be held.
+static void
+linkslab(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// take an object from c's slabs, growing the cache
+// if none are free. Returns 0 if out of memory.
+// c->lock must be held.
+static void*
+slaballoc(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *o;
+  void *obj;
+
+  if((s = c->partial) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->cache = c;
+    s->nfree = c->perslab;
+    s->free = 0;
+    o = (char*)s + ((sizeof(struct slab) + 7) & ~7);
+    for(int i = 0; i < c->perslab; i++, o += c->size){
+      *(void**)o = s->free;
+      s->free = o;
+    }
+    c->nslabs++;
+    linkslab(c, s);
+  }
+  obj = s->free;
+  s->free = *(void**)obj;
+  if(--s->nfree == 0)
+    unlinkslab(c, s);
+  return obj;
+}
+
+// return obj to its slab, freeing the slab if it is empty.
+// c->lock must be held.
+static void
+slabfree(struct kmem_cache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+
+  if(s->cache != c)
+    panic("kmem_cache_free: wrong cache");
+  *(void**)obj = s->free;
+  s->free = obj;
+  if(s->nfree++ == 0)
+    linkslab(c, s);
+  if(s->nfree == c->perslab){
+    unlinkslab(c, s);
+    c->nslabs--;
+    kfree(s);
+  }
+}
+
+// Allocate an object from c.
+// Returns 0 if out of memory.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n > 0){
+    obj = m->obj[--m->n];
+    pop_off();
+    return obj;
+  }
+  pop_off();
+
+  // acquire() keeps interrupts off, so this stays our magazine.
+  acquire(&c->lock);
+  m = &c->mag[cpuid()];
+  while(m->n < MAGSIZE/2 && (obj = slaballoc(c)) != 0){
+    m->obj[m->n++] = obj;
+    c->nobjs++;
+  }
+  obj = m->n > 0 ? m->obj[--m->n] : 0;
+  release(&c->lock);
+  return obj;
+}
+
+// Free an object allocated from c.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n < MAGSIZE){
+    m->obj[m->n++] = obj;
+    pop_off();
+    return;
+  }
+  pop_off();
+
+  acquire(&c->lock);
+  m = &c->mag[cpuid()];
+  while(m->n > MAGSIZE/2){
+    slabfree(c, m->obj[--m->n]);
+    c->nobjs--;
+  }
+  m->obj[m->n++] = obj;
+  release(&c->lock);
+}
+
+// Describe the caches, one line each, for /proc/mem.
+int
+slabprint(char *buf, int sz)
+{
+  struct kmem_cache *c;
+  int off = 0;
+
+  for(c = kcaches.cache; c < &kcaches.cache[kcaches.n] && off < sz-1; c++){
+    acquire(&c->lock);
+    off += snprintf(buf+off, sz-off, "slab %s size %d objs %d slabs %d\n",
+                    c->name, c->size, c->nobjs, c->nslabs);
+    release(&c->lock);
+  }
+  return off;
+}
@@ -8,12 +8,53 @@
 #include "proc.h"
 #include "defs.h"
 
+// Statistics are kept per lock name rather than per lock, so
+// that, say, all the "proc" locks add up to one line, and a
+// lock can be freed without anything to clean up. Each CPU
+// has its own counters, updated with interrupts off and no
+// atomics, and statslock() adds them up.
+#define NLOCKSTAT 64
+
+static char *locknames[NLOCKSTAT];
+static struct lockstat lockstats[NCPU][NLOCKSTAT];
+static uint nlockstat;
+static uint statlocked;   // guards adding to locknames[]
+
+// find or make the statistics entry for locks named name.
+// the last entry takes whatever doesn't fit.
+static int
+lockstat(char *name)
+{
+  int i;
+
+  while(__sync_lock_test_and_set(&statlocked, 1) != 0)
+    ;
+  __sync_synchronize();
+  for(i = 0; i < nlockstat; i++)
+    if(strncmp(locknames[i], name, MAXPATH) == 0)
+      break;
+  if(i == NLOCKSTAT){
+    i = NLOCKSTAT-1;
+  } else if(i == nlockstat){
+    locknames[i] = (i == NLOCKSTAT-1) ? "other" : name;
+    __sync_synchronize();
+    nlockstat++;
+  }
+  __sync_lock_release(&statlocked);
+  return i;
+}
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
+#ifdef TICKETLOCK
+  lk->next = 0;
+  lk->owner = 0;
+#endif
   lk->cpu = 0;
+  lk->stat = lockstat(name);
 }
 
 // Acquire the lock.
@@ -21,16 +62,28 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  struct lockstat *st;
+  uint64 spins = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#ifdef TICKETLOCK
+  // Take a ticket and wait for it to be served, so that CPUs
+  // get the lock in the order they asked for it.
+  uint ticket = __sync_fetch_and_add(&lk->next, 1);
+  while(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket)
+    spins++;
+  lk->locked = 1;
+#else
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    spins++;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +93,32 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  st = &lockstats[cpuid()][lk->stat];
+  st->nacquire++;
+  if(spins){
+    st->ncontend++;
+    st->nspin += spins;
+  }
+  lk->tacquire = r_cycle();
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  struct lockstat *st;
+  uint64 t;
+
   if(!holding(lk))
     panic("release");
 
+  // this CPU's, as it still holds the lock with interrupts off.
+  t = r_cycle() - lk->tacquire;
+  st = &lockstats[cpuid()][lk->stat];
+  if(t > st->maxhold)
+    st->maxhold = t;
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,6 +129,11 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#ifdef TICKETLOCK
+  // Serve the next ticket. Only the holder writes owner.
+  lk->locked = 0;
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
+#else
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +142,7 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#endif
 
   pop_off();
 }
@@ -81,6 +157,77 @@ holding(struct spinlock *lk)
   return r;
 }
 
+// Format the lock statistics into buf, busiest locks first,
+// as one line per lock name. Returns the length.
+int
+statslock(char *buf, int sz)
+{
+  struct lockstat *tot, *st, *cst;
+  int order[NLOCKSTAT];
+  int c, i, j, n, off, tmp;
+
+  if((tot = kalloc()) == 0)
+    return 0;
+  n = __atomic_load_n(&nlockstat, __ATOMIC_ACQUIRE);
+  memset(tot, 0, n * sizeof(*tot));
+  for(c = 0; c < NCPU; c++){
+    for(i = 0; i < n; i++){
+      st = &tot[i];
+      cst = &lockstats[c][i];
+      st->nacquire += cst->nacquire;
+      st->ncontend += cst->ncontend;
+      st->nspin += cst->nspin;
+      if(cst->maxhold > st->maxhold)
+        st->maxhold = cst->maxhold;
+    }
+  }
+
+  for(i = 0; i < n; i++)
+    order[i] = i;
+  // insertion sort by contention, then acquisitions.
+  for(i = 1; i < n; i++){
+    for(j = i; j > 0; j--){
+      st = &tot[order[j]];
+      cst = &tot[order[j-1]];
+      if(st->nspin < cst->nspin ||
+         (st->nspin == cst->nspin && st->nacquire <= cst->nacquire))
+        break;
+      tmp = order[j-1];
+      order[j-1] = order[j];
+      order[j] = tmp;
+    }
+  }
+
+  off = snprintf(buf, sz, "%s %s %s %s %s\n",
+                 "name", "acquires", "contended", "spins", "maxhold");
+  for(i = 0; i < n && off < sz-1; i++){
+    st = &tot[order[i]];
+    if(st->nacquire == 0)
+      continue;
+    off += snprintf(buf + off, sz - off, "%s %ld %ld %ld %ld\n", locknames[order[i]],
+                    st->nacquire, st->ncontend, st->nspin, st->maxhold);
+  }
+  kfree(tot);
+  return off;
+}
+
+// Zero the lock statistics.
+void
+statslockreset(void)
+{
+  int c, i, n;
+
+  n = __atomic_load_n(&nlockstat, __ATOMIC_ACQUIRE);
+  for(c = 0; c < NCPU; c++){
+    for(i = 0; i < n; i++){
+      lockstats[c][i].nacquire = 0;
+      lockstats[c][i].ncontend = 0;
+      lockstats[c][i].nspin = 0;
+      lockstats[c][i].maxhold = 0;
+    }
+  }
+}
+
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
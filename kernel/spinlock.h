@@ -1,9 +1,24 @@
 // Mutual exclusion lock.
 struct spinlock {
   uint locked;       // Is the lock held?
+#ifdef TICKETLOCK
+  uint next;         // next ticket to hand out
+  uint owner;        // ticket now being served
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For contention statistics:
+  int stat;          // index of the statistics for locks of this name
+  uint64 tacquire;   // cycle counter when acquired
 };
 
+// Totals for all spinlocks that share a name, on one CPU.
+struct lockstat {
+  uint64 nacquire;   // acquisitions
+  uint64 ncontend;   // acquisitions that had to spin
+  uint64 nspin;      // spin loop iterations
+  uint64 maxhold;    // longest hold, in cycles
+};
@@ -0,0 +1,107 @@
+//
+// formatted output to a string -- snprintf.
+//
+
+#include <stdarg.h>
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+
+static char digits[] = "0123456789abcdef";
+
+static int
+sputc(char *s, char c)
+{
+  *s = c;
+  return 1;
+}
+
+static int
+sprintint(char *s, int sz, long long xx, int base, int sign)
+{
+  char buf[24];
+  int i, n;
+  unsigned long long x;
+
+  if(sign && (sign = (xx < 0)))
+    x = -xx;
+  else
+    x = xx;
+
+  i = 0;
+  do {
+    buf[i++] = digits[x % base];
+  } while((x /= base) != 0);
+
+  if(sign)
+    buf[i++] = '-';
+
+  n = 0;
+  while(--i >= 0 && n < sz)
+    n += sputc(s+n, buf[i]);
+  return n;
+}
+
+// Print to buf, writing at most sz-1 characters and a NUL.
+// Returns the number of characters written, not counting
+// the NUL.
+int
+snprintf(char *buf, int sz, char *fmt, ...)
+{
+  va_list ap;
+  int i, cx, c0, c1, off;
+  char *s;
+
+  if(sz <= 0)
+    return 0;
+  sz--;   // room for the NUL
+
+  va_start(ap, fmt);
+  off = 0;
+  for(i = 0; (cx = fmt[i] & 0xff) != 0 && off < sz; i++){
+    if(cx != '%'){
+      off += sputc(buf+off, cx);
+      continue;
+    }
+    i++;
+    c0 = fmt[i+0] & 0xff;
+    c1 = 0;
+    if(c0) c1 = fmt[i+1] & 0xff;
+    if(c0 == 'd'){
+      off += sprintint(buf+off, sz-off, va_arg(ap, int), 10, 1);
+    } else if(c0 == 'l' && c1 == 'd'){
+      off += sprintint(buf+off, sz-off, va_arg(ap, uint64), 10, 1);
+      i += 1;
+    } else if(c0 == 'u'){
+      off += sprintint(buf+off, sz-off, va_arg(ap, uint), 10, 0);
+    } else if(c0 == 'l' && c1 == 'u'){
+      off += sprintint(buf+off, sz-off, va_arg(ap, uint64), 10, 0);
+      i += 1;
+    } else if(c0 == 'x'){
+      off += sprintint(buf+off, sz-off, va_arg(ap, uint), 16, 0);
+    } else if(c0 == 'l' && c1 == 'x'){
+      off += sprintint(buf+off, sz-off, va_arg(ap, uint64), 16, 0);
+      i += 1;
+    } else if(c0 == 'c'){
+      off += sputc(buf+off, va_arg(ap, int));
+    } else if(c0 == 's'){
+      if((s = va_arg(ap, char*)) == 0)
+        s = "(null)";
+      for(; *s && off < sz; s++)
+        off += sputc(buf+off, *s);
+    } else if(c0 == '%'){
+      off += sputc(buf+off, '%');
+    } else if(c0 == 0){
+      break;
+    } else {
+      // Print unknown % sequence to draw attention.
+      off += sputc(buf+off, '%');
+      if(off < sz)
+        off += sputc(buf+off, c0);
+    }
+  }
+  va_end(ap);
+  buf[off] = 0;
+  return off;
+}
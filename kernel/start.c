@@ -6,6 +6,8 @@
 
 void main();
 void timerinit();
+void ipiinit(int);
+void ipivec();  // in kernelvec.S
 
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
@@ -44,6 +46,9 @@ start()
   int id = r_mhartid();
   w_tp(id);
 
+  // let other harts interrupt this one.
+  ipiinit(id);
+
   // switch to supervisor mode and jump to main().
   asm volatile("mret");
 }
@@ -58,9 +63,22 @@ timerinit()
   // enable the sstc extension (i.e. stimecmp).
   w_menvcfg(r_menvcfg() | (1L << 63)); 
   
-  // allow supervisor to use stimecmp and time.
-  w_mcounteren(r_mcounteren() | 2);
+  // allow supervisor to use stimecmp, and supervisor and user
+  // mode to read cycle, time, instret and the hpmcounters.
+  w_mcounteren(0xffffffff);
+  w_scounteren(0xffffffff);
   
   // ask for the very first timer interrupt.
-  w_stimecmp(r_time() + 1000000);
+  w_stimecmp(r_time() + TICKCYCLES);
+}
+
+// a machine-mode software interrupt, raised by another hart's
+// sendipi(), can't be delegated; ipivec in kernelvec.S turns
+// it into a supervisor software interrupt.
+void
+ipiinit(int id)
+{
+  w_mscratch(CLINT_MSIP(id));
+  w_mtvec((uint64)ipivec);
+  w_mie(r_mie() | MIE_MSIE);
 }
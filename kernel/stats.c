@@ -0,0 +1,65 @@
+//
+// The statistics device: reading it gives a table of lock
+// contention, one line per lock name, busiest first; writing
+// anything to it zeroes the counts.
+//
+// Like the console, the device has no file offset. A read
+// formats a fresh snapshot once, then returns it in pieces to
+// successive reads, then returns 0 for end of file.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define BUFSZ 4096
+
+static struct {
+  struct sleeplock lock;
+  char buf[BUFSZ];
+  int sz;     // length of the snapshot in buf
+  int off;    // how much of it has been read
+} stats;
+
+int
+statsread(int user_dst, uint64 dst, int n)
+{
+  int m;
+
+  acquiresleep(&stats.lock);
+  if(stats.sz == 0)
+    stats.sz = statslock(stats.buf, BUFSZ);
+  m = stats.sz - stats.off;
+  if(m > n)
+    m = n;
+  if(m > 0 && either_copyout(user_dst, dst, stats.buf + stats.off, m) < 0){
+    releasesleep(&stats.lock);
+    return -1;
+  }
+  stats.off += m;
+  if(m == 0)
+    stats.sz = stats.off = 0;
+  releasesleep(&stats.lock);
+  return m;
+}
+
+int
+statswrite(int user_src, uint64 src, int n)
+{
+  statslockreset();
+  return n;
+}
+
+void
+statsinit(void)
+{
+  initsleeplock(&stats.lock, "stats");
+
+  devsw[STATS].read = statsread;
+  devsw[STATS].write = statswrite;
+}
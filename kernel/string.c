@@ -1,13 +1,45 @@
 #include "types.h"
+#ifdef STRINGTEST
+#include "riscv.h"
+#include "defs.h"
+#endif
+
+// memset, memcmp and memmove work a 64-bit word at a time
+// where they can: bytes up to an 8-byte boundary, then words,
+// four per loop iteration, then the leftover bytes. memmove and
+// memcmp can only use words when both pointers are equally
+// misaligned; otherwise they fall back to bytes.
+
+#define WALIGNED(p) (((uint64)(p) & 7) == 0)
 
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = (uchar*)dst;
+  uint64 w, *wd;
+
+  while(n > 0 && !WALIGNED(d)){
+    *d++ = c;
+    n--;
+  }
+  if(n >= 8){
+    w = (uchar)c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+    wd = (uint64*)d;
+    for(; n >= 32; n -= 32, wd += 4){
+      wd[0] = w;
+      wd[1] = w;
+      wd[2] = w;
+      wd[3] = w;
+    }
+    for(; n >= 8; n -= 8)
+      *wd++ = w;
+    d = (uchar*)wd;
   }
+  while(n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -15,9 +47,24 @@ int
 memcmp(const void *v1, const void *v2, uint n)
 {
   const uchar *s1, *s2;
+  const uint64 *w1, *w2;
 
   s1 = v1;
   s2 = v2;
+  if((((uint64)s1 ^ (uint64)s2) & 7) == 0){
+    while(n > 0 && !WALIGNED(s1)){
+      if(*s1 != *s2)
+        return *s1 - *s2;
+      s1++, s2++, n--;
+    }
+    // stop at the first differing word; the bytes say which.
+    w1 = (const uint64*)s1;
+    w2 = (const uint64*)s2;
+    for(; n >= 8 && *w1 == *w2; n -= 8)
+      w1++, w2++;
+    s1 = (const uchar*)w1;
+    s2 = (const uchar*)w2;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -32,20 +79,66 @@ memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
+  const uint64 *ws;
+  uint64 *wd;
+  int words;
 
   if(n == 0)
     return dst;
   
   s = src;
   d = dst;
+  words = (((uint64)s ^ (uint64)d) & 7) == 0;
   if(s < d && s + n > d){
+    // overlapping, dst above src: copy from the end.
     s += n;
     d += n;
+    if(words){
+      while(n > 0 && !WALIGNED(d)){
+        *--d = *--s;
+        n--;
+      }
+      ws = (const uint64*)s;
+      wd = (uint64*)d;
+      for(; n >= 32; n -= 32){
+        ws -= 4, wd -= 4;
+        wd[3] = ws[3];
+        wd[2] = ws[2];
+        wd[1] = ws[1];
+        wd[0] = ws[0];
+      }
+      for(; n >= 8; n -= 8)
+        *--wd = *--ws;
+      s = (const char*)ws;
+      d = (char*)wd;
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+    if(words){
+      while(n > 0 && !WALIGNED(d)){
+        *d++ = *s++;
+        n--;
+      }
+      ws = (const uint64*)s;
+      wd = (uint64*)d;
+      // each group is loaded before it is stored, which is
+      // safe when dst lies below an overlapping src.
+      for(; n >= 32; n -= 32, ws += 4, wd += 4){
+        uint64 a = ws[0], b = ws[1], c = ws[2], e = ws[3];
+        wd[0] = a;
+        wd[1] = b;
+        wd[2] = c;
+        wd[3] = e;
+      }
+      for(; n >= 8; n -= 8)
+        *wd++ = *ws++;
+      s = (const char*)ws;
+      d = (char*)wd;
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
@@ -105,3 +198,147 @@ strlen(const char *s)
   return n;
 }
 
+
+#ifdef STRINGTEST
+// Boot-time check and benchmark of memset, memcmp and memmove
+// against byte-at-a-time versions; make STRINGTEST=1.
+
+static void*
+bytememset(void *dst, int c, uint n)
+{
+  volatile char *d = dst;
+  while(n-- > 0)
+    *d++ = c;
+  return dst;
+}
+
+static int
+bytememcmp(const void *v1, const void *v2, uint n)
+{
+  const volatile uchar *s1 = v1, *s2 = v2;
+  for(; n > 0; n--, s1++, s2++)
+    if(*s1 != *s2)
+      return *s1 - *s2;
+  return 0;
+}
+
+static void*
+bytememmove(void *dst, const void *src, uint n)
+{
+  const volatile char *s = src;
+  volatile char *d = dst;
+  if(s < d && s + n > d){
+    s += n;
+    d += n;
+    while(n-- > 0)
+      *--d = *--s;
+  } else
+    while(n-- > 0)
+      *d++ = *s++;
+  return dst;
+}
+
+static int
+sign(int x)
+{
+  return x < 0 ? -1 : x > 0;
+}
+
+// check every size up to 80 at every pair of offsets in a
+// word, including overlapping moves in both directions.
+static void
+stringcheck(char *a, char *b)
+{
+  uint n, i, j, k;
+
+  for(n = 0; n <= 80; n++){
+    for(i = 0; i < 8; i++){
+      for(j = 0; j < 8; j++){
+        for(k = 0; k < 256; k++)
+          a[k] = b[k] = k * 7 + 3;
+        memset(a + 32 + i, 0xa5 + n, n);
+        bytememset(b + 32 + i, 0xa5 + n, n);
+        if(bytememcmp(a, b, 256) != 0)
+          panic("stringtest: memset");
+
+        memmove(a + 32 + i, a + 40 + j, n);
+        bytememmove(b + 32 + i, b + 40 + j, n);
+        memmove(a + 40 + i, a + 32 + j, n);
+        bytememmove(b + 40 + i, b + 32 + j, n);
+        memmove(a + 128 + i, a + j, n);
+        bytememmove(b + 128 + i, b + j, n);
+        if(bytememcmp(a, b, 256) != 0)
+          panic("stringtest: memmove");
+
+        if(n > 0)
+          b[128 + i + (j * 5) % n] ^= 1 << (j % 8);
+        if(sign(memcmp(a + 128 + i, b + 128 + i, n)) !=
+           sign(bytememcmp(a + 128 + i, b + 128 + i, n)) ||
+           sign(memcmp(b + 128 + i, a + 128 + i, n)) !=
+           sign(bytememcmp(b + 128 + i, a + 128 + i, n)) ||
+           sign(memcmp(a + i, b + j, n)) != sign(bytememcmp(a + i, b + j, n)))
+          panic("stringtest: memcmp");
+      }
+    }
+  }
+}
+
+// print n bytes in t cycles as bytes/cycle with two decimals.
+static void
+rate(char *what, uint n, uint64 t)
+{
+  uint64 r = (uint64)n * 100 / (t ? t : 1);
+  printf(" %s %d.%d%d", what, (int)(r / 100), (int)(r / 10 % 10), (int)(r % 10));
+}
+
+void
+stringtest(void)
+{
+  static uint sizes[] = { 16, 64, 256, 1024, 4096 };
+  char *a, *b;
+  uint64 t0, t1, t2, t3, t4, t5, t6;
+  int i, k, iters;
+  uint n;
+
+  if((a = kalloc()) == 0 || (b = kalloc()) == 0)
+    panic("stringtest: kalloc");
+  stringcheck(a, b);
+
+  printf("stringtest: bytes/cycle, byte-wise vs word-wise\n");
+  for(i = 0; i < NELEM(sizes); i++){
+    n = sizes[i];
+    iters = (1 << 20) / n;
+    t0 = r_cycle();
+    for(k = 0; k < iters; k++)
+      bytememset(a, k, n);
+    t1 = r_cycle();
+    for(k = 0; k < iters; k++)
+      memset(a, k, n);
+    t2 = r_cycle();
+    for(k = 0; k < iters; k++)
+      bytememmove(b, a, n);
+    t3 = r_cycle();
+    for(k = 0; k < iters; k++)
+      memmove(b, a, n);
+    t4 = r_cycle();
+    for(k = 0; k < iters; k++)
+      bytememcmp(a, b, n);
+    t5 = r_cycle();
+    for(k = 0; k < iters; k++)
+      memcmp(a, b, n);
+    t6 = r_cycle();
+
+    printf("%d:", n);
+    rate("memset", n * iters, t1 - t0);
+    rate("/", n * iters, t2 - t1);
+    rate("memmove", n * iters, t3 - t2);
+    rate("/", n * iters, t4 - t3);
+    rate("memcmp", n * iters, t5 - t4);
+    rate("/", n * iters, t6 - t5);
+    printf("\n");
+  }
+
+  kfree(a);
+  kfree(b);
+}
+#endif
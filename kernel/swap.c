@@ -0,0 +1,371 @@
+// Swapping.
+//
+// When kalloc() runs dry, swapout() picks a page of some user
+// process with a clock hand that sweeps every process image
+// [0, sz), giving pages whose PTE_A bit the hardware has set
+// since the last sweep a second chance. A page that was never
+// written (PTE_D clear) and lies in one of the program's ELF
+// segments is just dropped; execfault() reads it in again. Any
+// other page is written to a slot of the swap area, which
+// follows the file system on the disk, and its PTE is left
+// holding PTE_SWAP and the slot number. A fault on such a PTE
+// calls swapin().
+//
+// Only pages with a single reference are swapped, and only of
+// processes that aren't running and have no threads, since
+// evict() holds locks and can't wait for a tlbshootdown().
+// Pages that uvmprefault() pinned for a sleeping system call
+// are skipped. fork() shares a swapped page by sharing its
+// slot; slot reference counts say when a slot is free.
+//
+// swap.lock serializes all swap I/O and slot allocation, so
+// that a swapin() of a page waits for its swapout() to finish.
+// Lock order: swap.lock, then p->lock, then the leader's vmlock.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "buf.h"
+#include "swap.h"
+#include "defs.h"
+
+#define BPP (PGSIZE / BSIZE)           // blocks per page
+#define NSLOT (SWAPBLOCKS / BPP)
+
+extern struct proc *allproc;
+extern int nallproc;
+
+struct {
+  struct sleeplock lock;
+  struct spinlock slotlock;    // protects ref[] and stat
+  ushort ref[NSLOT];           // page table entries holding each slot
+  struct buf buf;              // for disk I/O; swap.lock protects
+  int handpid;                 // clock hand: this proc, 0 for the first,
+  uint64 handva;               // at this virtual address
+  struct swapstat stat;
+} swap;
+
+void
+swapinit(void)
+{
+  initsleeplock(&swap.lock, "swap");
+  initlock(&swap.slotlock, "swapslot");
+  swap.stat.nslots = NSLOT;
+}
+
+// allocate a slot, or return -1 if swap is full.
+static int
+slotalloc(void)
+{
+  int i;
+
+  acquire(&swap.slotlock);
+  for(i = 0; i < NSLOT; i++){
+    if(swap.ref[i] == 0){
+      swap.ref[i] = 1;
+      swap.stat.used++;
+      release(&swap.slotlock);
+      return i;
+    }
+  }
+  release(&swap.slotlock);
+  return -1;
+}
+
+// Add a reference to a slot, for a PTE copied by fork().
+void
+swapdup(uint slot)
+{
+  acquire(&swap.slotlock);
+  if(slot >= NSLOT || swap.ref[slot] == 0)
+    panic("swapdup");
+  swap.ref[slot]++;
+  release(&swap.slotlock);
+}
+
+// Drop a reference to a slot, for a PTE that goes away.
+void
+swapfree(uint slot)
+{
+  acquire(&swap.slotlock);
+  if(slot >= NSLOT || swap.ref[slot] == 0)
+    panic("swapfree");
+  if(--swap.ref[slot] == 0)
+    swap.stat.used--;
+  release(&swap.slotlock);
+}
+
+// read or write the page mem at slot.
+// swap.lock must be held.
+static void
+swapio(uint slot, char *mem, int write)
+{
+  struct buf *b = &swap.buf;
+
+  b->dev = ROOTDEV;
+  for(int i = 0; i < BPP; i++){
+    b->blockno = FSSIZE + slot * BPP + i;
+    if(write)
+      memmove(b->data, mem + i*BSIZE, BSIZE);
+    virtio_disk_rw(b, write);
+    if(!write)
+      memmove(mem + i*BSIZE, b->data, BSIZE);
+  }
+}
+
+// is the page at va in a range that a system call p is
+// sleeping in faulted in with uvmprefault(), and will copy to
+// or from? p->lock must be held, with p not running.
+static int
+pinned(struct proc *p, uint64 va)
+{
+  int i;
+
+  if(p->npins > NPIN)
+    return 1;
+  for(i = 0; i < p->npins; i++)
+    if(va + PGSIZE > p->pins[i].va && va < p->pins[i].va + p->pins[i].len)
+      return 1;
+  return 0;
+}
+
+// is va in a segment of l's program, so that a clean page
+// there can be read from the file again?
+// l->vmlock must be held.
+static int
+inprogram(struct proc *l, uint64 va)
+{
+  struct execseg *s;
+
+  if(l->exe == 0)
+    return 0;
+  for(s = l->seg; s < &l->seg[NEXECSEG] && s->memsz; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      return 1;
+  return 0;
+}
+
+// Advance the clock hand to the next page to evict, and take
+// it out of its page table. Returns the page, with *slot set
+// to the swap slot its PTE now names, or to -1 if it was clean
+// and is simply dropped. Returns 0 if there is nothing to evict.
+// swap.lock must be held.
+static char*
+evict(int *slot)
+{
+  struct proc *p;
+  pte_t *pte;
+  uint64 va, pa;
+  int n;
+
+  // the hand is kept as a pid: its proc may have been freed
+  // since the last call. start over if it has exited.
+  push_off();  // walking allproc
+  if(swap.handpid != 0 && (p = findproc(swap.handpid)) != 0){
+    release(&p->lock);
+  } else {
+    p = 0;
+    swap.handva = 0;
+  }
+
+  // two sweeps: the first may only clear PTE_A bits.
+  for(n = 0; n < 2*nallproc + 1; n++){
+    if(p == 0)
+      p = allproc;
+    acquire(&p->lock);
+    if((p->state == SLEEPING || p->state == RUNNABLE) && p->leader == p){
+      acquire(&p->vmlock);
+      for(va = swap.handva; p->tslots == 0 && va < p->sz; va += PGSIZE){
+        if((pte = walk(p->pagetable, va, 0)) == 0)
+          continue;
+        if((*pte & (PTE_V | PTE_U)) != (PTE_V | PTE_U) || (*pte & PTE_PS))
+          continue;
+        if(pinned(p, va))
+          continue;
+        pa = PTE2PA(*pte);
+        if(krefcount((void*)pa) != 1)
+          continue;
+        if(*pte & PTE_A){
+          // used since the last sweep. no sfence needed: the
+          // TLB is flushed before p next runs.
+          *pte &= ~PTE_A;
+          continue;
+        }
+        if((*pte & PTE_D) == 0 && inprogram(p, va)){
+          *slot = -1;
+          *pte = 0;
+        } else if((*slot = slotalloc()) >= 0){
+          *pte = SLOT2PTE(*slot) | (PTE_FLAGS(*pte) & ~(PTE_V|PTE_A)) | PTE_SWAP;
+        } else {
+          pa = 0;
+        }
+        swap.handpid = p->pid;
+        swap.handva = va + PGSIZE;
+        release(&p->vmlock);
+        release(&p->lock);
+        pop_off();
+        return (char*)pa;
+      }
+      release(&p->vmlock);
+    }
+    release(&p->lock);
+    p = p->next;
+    swap.handva = 0;
+  }
+  swap.handpid = 0;
+  pop_off();
+  return 0;
+}
+
+// Free a page of memory by dropping the page cache's least
+// recently used page or by evicting a user page.
+// Returns 0, or -1 if nothing could be freed.
+// Must not hold any spinlock.
+int
+swapout(void)
+{
+  char *mem;
+  int slot;
+
+  if(pcshrink() == 0)
+    return 0;
+
+  acquiresleep(&swap.lock);
+  if((mem = evict(&slot)) == 0){
+    releasesleep(&swap.lock);
+    return -1;
+  }
+  if(slot >= 0){
+    // the process may exit and free the slot meanwhile, but
+    // no one can reuse it before swap.lock is released.
+    swapio(slot, mem, 1);
+  }
+  releasesleep(&swap.lock);
+  kfree(mem);
+
+  acquire(&swap.slotlock);
+  if(slot >= 0)
+    swap.stat.swapouts++;
+  else
+    swap.stat.drops++;
+  release(&swap.slotlock);
+  return 0;
+}
+
+// Allocate a page like kalloc(), or kalloc_zeroed() if
+// zeroed, swapping out another to make room if need be.
+// Must not hold any spinlock.
+void*
+swapalloc(int zeroed)
+{
+  void *mem;
+
+  while((mem = zeroed ? kalloc_zeroed() : kalloc()) == 0)
+    if(swapout() < 0)
+      return 0;
+  return mem;
+}
+
+// Make room for n more pages before a caller that will
+// allocate them holding a spinlock, as far as possible.
+void
+swapreserve(uint64 n)
+{
+  // page-table pages and the like.
+  n += 16;
+  while(kfreepages() < n)
+    if(swapout() < 0)
+      break;
+}
+
+// Read back the page at va of p, whose PTE is a swapped
+// one, after a page fault.
+// Returns 0, or -1 if there is no memory.
+int
+swapin(struct proc *p, uint64 va)
+{
+  struct proc *l = p->leader;
+  pte_t *pte, pte0;
+  char *mem;
+  int r;
+
+  va = PGROUNDDOWN(va);
+  if((mem = swapalloc(0)) == 0)
+    return -1;
+
+  acquiresleep(&swap.lock);
+  acquire(&l->vmlock);
+  pte = walk(l->pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_SWAP) == 0){
+    // another thread read it in first, or it was unmapped.
+    r = (pte && (*pte & PTE_V)) ? 0 : -1;
+    release(&l->vmlock);
+    releasesleep(&swap.lock);
+    kfree(mem);
+    return r;
+  }
+  pte0 = *pte;
+  release(&l->vmlock);
+
+  swapio(PTE2SLOT(pte0), mem, 0);
+
+  r = 0;
+  acquire(&l->vmlock);
+  if(*pte != pte0){
+    // unmapped while reading.
+    kfree(mem);
+    r = -1;
+  } else {
+    // it differs from the program file now, if it was ever there.
+    *pte = PA2PTE(mem) | (PTE_FLAGS(pte0) & ~PTE_SWAP) | PTE_V | PTE_D;
+    swapfree(PTE2SLOT(pte0));
+  }
+  release(&l->vmlock);
+  releasesleep(&swap.lock);
+
+  acquire(&swap.slotlock);
+  swap.stat.swapins++;
+  swap.stat.majfaults++;
+  release(&swap.slotlock);
+  return r;
+}
+
+// Count a page fault that didn't need to read swap.
+void
+swapminfault(void)
+{
+  acquire(&swap.slotlock);
+  swap.stat.minfaults++;
+  release(&swap.slotlock);
+}
+
+// Copy the paging statistics to user address addr.
+int
+swapstat(uint64 addr)
+{
+  struct swapstat st;
+
+  acquire(&swap.slotlock);
+  st = swap.stat;
+  release(&swap.slotlock);
+  return copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st));
+}
+
+// Describe paging, for /proc/mem.
+int
+swapprint(char *buf, int sz)
+{
+  struct swapstat st;
+
+  acquire(&swap.slotlock);
+  st = swap.stat;
+  release(&swap.slotlock);
+  return snprintf(buf, sz, "swapslots %d\nswapused %d\nswapouts %ld\nswapins %ld\n"
+                  "drops %ld\nmajfaults %ld\nminfaults %ld\n", st.nslots, st.used,
+                  st.swapouts, st.swapins, st.drops, st.majfaults, st.minfaults);
+}
@@ -0,0 +1,10 @@
+// Paging statistics, from swapstat().
+struct swapstat {
+  uint64 swapouts;   // pages written to swap
+  uint64 swapins;    // pages read back from swap
+  uint64 drops;      // clean program pages dropped, to be faulted in again
+  uint64 majfaults;  // page faults that waited for a swap read
+  uint64 minfaults;  // other page faults
+  int nslots;        // pages of swap space
+  int used;          // pages of swap space in use
+};
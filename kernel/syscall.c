@@ -5,6 +5,8 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "sysstat.h"
+#include "ring.h"
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
@@ -12,7 +14,8 @@ int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz) // both tests needed, in case of overflow
+  uint64 sz = p->leader->sz;
+  if(addr >= sz || addr+sizeof(uint64) > sz) // both tests needed, in case of overflow
     return -1;
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -102,6 +105,30 @@ extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
 extern int sys_check_superpages(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_nice(void);
+extern uint64 sys_clock_gettime(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_shmget(void);
+extern uint64 sys_shmat(void);
+extern uint64 sys_shmdt(void);
+extern uint64 sys_shmrm(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_swapstat(void);
+extern uint64 sys_profctl(void);
+extern uint64 sys_profread(void);
+extern uint64 sys_sysstat(void);
+extern uint64 sys_getcounters(void);
+extern uint64 sys_ringsetup(void);
+extern uint64 sys_ringenter(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_dmesg(void);
+extern uint64 sys_fastcalls(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -127,8 +154,68 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_setpriority] sys_setpriority,
+[SYS_nice]    sys_nice,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex]   sys_futex,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_shmrm]   sys_shmrm,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_swapstat] sys_swapstat,
+[SYS_profctl] sys_profctl,
+[SYS_profread] sys_profread,
+[SYS_sysstat] sys_sysstat,
+[SYS_getcounters] sys_getcounters,
+[SYS_ringsetup] sys_ringsetup,
+[SYS_ringenter] sys_ringenter,
+[SYS_poll]    sys_poll,
+[SYS_fcntl]   sys_fcntl,
+[SYS_dmesg]   sys_dmesg,
+[SYS_fastcalls] sys_fastcalls,
 };
 
+// system-wide statistics, kept per CPU so that counting a
+// call takes no lock. a call is counted on the CPU it ends on.
+static struct sysstat cpusysstat[NCPU][NSYSCALL];
+
+static void
+countcall(struct sysstat *s, uint64 t)
+{
+  s->count++;
+  s->time += t;
+  if(t > s->max)
+    s->max = t;
+}
+
+// call system call num, with its arguments in p's trapframe,
+// and count it.
+static uint64
+callsys(struct proc *p, int num)
+{
+  uint64 t0, t, r;
+  int npins;
+
+  // a call from ringenter() drops only its own pins.
+  npins = p->npins;
+  t0 = r_time();
+  r = syscalls[num]();
+  t = r_time() - t0;
+  p->npins = npins;
+
+  // exit() doesn't return, so it is never counted.
+  countcall(&p->sysstat[num], t);
+  push_off();
+  countcall(&cpusysstat[cpuid()][num], t);
+  pop_off();
+  return r;
+}
+
 void
 syscall(void)
 {
@@ -139,10 +226,175 @@ syscall(void)
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
-    p->trapframe->a0 = syscalls[num]();
+    p->trapframe->a0 = callsys(p, num);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
     p->trapframe->a0 = -1;
   }
 }
+
+// Copy up to n struct sysstats, indexed by system call number,
+// to user address addr: the totals for the whole system if pid
+// is 0, else those of process pid.
+// Returns the number copied, or -1.
+int
+sysstat(int pid, uint64 addr, int n)
+{
+  struct sysstat *st;
+  int i, c, r;
+
+  if(n < 0)
+    return -1;
+  if(n > NSYSCALL)
+    n = NSYSCALL;
+  if((st = kalloc()) == 0)
+    return -1;
+  if(pid == 0){
+    memset(st, 0, n * sizeof(*st));
+    for(c = 0; c < NCPU; c++){
+      for(i = 0; i < n; i++){
+        st[i].count += cpusysstat[c][i].count;
+        st[i].time += cpusysstat[c][i].time;
+        if(cpusysstat[c][i].max > st[i].max)
+          st[i].max = cpusysstat[c][i].max;
+      }
+    }
+  } else if(procsysstat(pid, st, n) < 0){
+    kfree(st);
+    return -1;
+  }
+  r = copyout(myproc()->pagetable, addr, (char*)st, n * sizeof(*st));
+  kfree(st);
+  return r < 0 ? -1 : n;
+}
+
+// Make the ring of size entries at user address addr the
+// process's ring for ringenter(). addr 0 removes it.
+// Returns 0, or -1.
+int
+ringsetup(uint64 addr, int size)
+{
+  struct proc *l = myproc()->leader;
+
+  if(addr == 0){
+    l->ring = 0;
+    return 0;
+  }
+  if(size <= 0 || size > RINGMAX || (size & (size-1)) || addr % 8)
+    return -1;
+  l->ring = addr;
+  l->ringsize = size;
+  return 0;
+}
+
+// system calls that may be made through the ring.
+static char ringops[NSYSCALL] = {
+[SYS_read]  1,
+[SYS_write] 1,
+[SYS_open]  1,
+[SYS_close] 1,
+[SYS_fstat] 1,
+};
+
+// guards each leader's ringbusy.
+struct spinlock ringlock;
+
+void
+ringinit(void)
+{
+  initlock(&ringlock, "ring");
+}
+
+// Carry out up to n entries of the process's submission ring,
+// in order, each as if it were a system call of its own, and
+// post a completion for each. Stops early if the completion
+// ring fills up or the process is killed. An entry with an op
+// that isn't allowed completes with -1.
+// The caller is the only thread of its process in here.
+// Returns the number of entries carried out, or -1.
+static int
+ringrun(int n)
+{
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+  struct trapframe *tf = p->trapframe;
+  struct ring r;
+  struct sqe sqe;
+  struct cqe cqe;
+  uint64 ring, sq, cq, a0, a1, a2;
+  uint mask;
+  int done;
+
+  if((ring = l->ring) == 0)
+    return -1;
+  mask = l->ringsize - 1;
+  sq = ring + sizeof(struct ring);
+  cq = sq + l->ringsize * sizeof(struct sqe);
+  if(copyin(p->pagetable, (char*)&r, ring, sizeof(r)) < 0)
+    return -1;
+
+  // the entries' arguments go where the system calls look.
+  a0 = tf->a0;
+  a1 = tf->a1;
+  a2 = tf->a2;
+  for(done = 0; done < n && r.sqhead != r.sqtail; done++){
+    if(r.cqtail - r.cqhead > mask || killed(p))
+      break;
+    if(copyin(p->pagetable, (char*)&sqe, sq + (r.sqhead & mask) * sizeof(sqe), sizeof(sqe)) < 0)
+      break;
+    cqe.data = sqe.data;
+    cqe.pad = 0;
+    if(sqe.op > 0 && sqe.op < NSYSCALL && ringops[sqe.op]){
+      tf->a0 = sqe.arg[0];
+      tf->a1 = sqe.arg[1];
+      tf->a2 = sqe.arg[2];
+      cqe.res = callsys(p, sqe.op);
+    } else {
+      cqe.res = -1;
+    }
+    if(copyout(p->pagetable, cq + (r.cqtail & mask) * sizeof(cqe), (char*)&cqe, sizeof(cqe)) < 0)
+      break;
+    r.sqhead++;
+    r.cqtail++;
+  }
+  tf->a0 = a0;
+  tf->a1 = a1;
+  tf->a2 = a2;
+
+  // only the kernel's two indices; the user may be moving the others.
+  if(copyout(p->pagetable, ring + ((char*)&r.sqhead - (char*)&r), (char*)&r.sqhead, sizeof(uint)) < 0 ||
+     copyout(p->pagetable, ring + ((char*)&r.cqtail - (char*)&r), (char*)&r.cqtail, sizeof(uint)) < 0)
+    return -1;
+  return done;
+}
+
+// ringrun() for the caller's process, once any other of its
+// threads has finished there: each runs the entries from the
+// head it reads, so two at once would run the same ones.
+int
+ringenter(int n)
+{
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+  int r;
+
+  acquire(&ringlock);
+  while(l->ringbusy){
+    if(killed(p)){
+      release(&ringlock);
+      return -1;
+    }
+    sleep(&l->ringbusy, &ringlock);
+  }
+  l->ringbusy = 1;
+  release(&ringlock);
+
+  r = ringrun(n);
+
+  acquire(&ringlock);
+  l->ringbusy = 0;
+  wakeup(&l->ringbusy);
+  release(&ringlock);
+  return r;
+}
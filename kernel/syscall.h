@@ -21,4 +21,46 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_check_superpages 22
+#define SYS_setpriority 23
+#define SYS_nice   24
+#define SYS_clock_gettime 25
+#define SYS_nanosleep 26
+#define SYS_clone  27
+#define SYS_join   28
+#define SYS_futex  29
+#define SYS_shmget 30
+#define SYS_shmat  31
+#define SYS_shmdt  32
+#define SYS_shmrm  33
+#define SYS_mmap   34
+#define SYS_munmap 35
+#define SYS_swapstat 36
+#define SYS_profctl 37
+#define SYS_profread 38
+#define SYS_sysstat 39
+#define SYS_getcounters 40
+#define SYS_ringsetup 41
+#define SYS_ringenter 42
+#define SYS_poll   43
+#define SYS_fcntl  44
+#define SYS_dmesg  45
+#define SYS_fastcalls 46
+
+#define NSYSCALL    47  // one more than the highest number
+
+// system calls that uservec in trampoline.S sends down its
+// fast path, which saves and restores only a few registers.
+// they mustn't copy or replace the process's registers, as
+// fork(), exec() and clone() do.
+#define SYSBIT(n)   (1ULL << (n))
+#define FASTCALLS   (SYSBIT(SYS_read) | SYSBIT(SYS_write) | SYSBIT(SYS_close) | \
+                     SYSBIT(SYS_fstat) | SYSBIT(SYS_dup) | SYSBIT(SYS_getpid) | \
+                     SYSBIT(SYS_uptime) | SYSBIT(SYS_kill) | SYSBIT(SYS_sleep) | \
+                     SYSBIT(SYS_clock_gettime) | SYSBIT(SYS_nanosleep) | \
+                     SYSBIT(SYS_sysstat) | SYSBIT(SYS_getcounters) | \
+                     SYSBIT(SYS_ringenter) | SYSBIT(SYS_poll) | SYSBIT(SYS_fcntl) | \
+                     SYSBIT(SYS_dmesg))
+// of those, ones that run with interrupts off: they neither
+// sleep nor touch user memory, which may need a page fault.
+#define NOINTRCALLS (SYSBIT(SYS_getpid) | SYSBIT(SYS_uptime))
 
@@ -17,7 +17,8 @@
 #include "fcntl.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return both the descriptor and the corresponding struct file,
+// with a reference from fdfile() that the caller must fileclose().
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
@@ -25,29 +26,37 @@ argfd(int n, int *pfd, struct file **pf)
   struct file *f;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdfile(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
   if(pf)
     *pf = f;
+  else
+    fileclose(f);
   return 0;
 }
 
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
+// The leader's lock keeps threads sharing the table
+// from claiming the same descriptor.
 static int
 fdalloc(struct file *f)
 {
   int fd;
   struct proc *p = myproc();
+  struct proc *l = p->leader;
 
+  acquire(&l->lock);
   for(fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd] == 0){
       p->ofile[fd] = f;
+      release(&l->lock);
       return fd;
     }
   }
+  release(&l->lock);
   return -1;
 }
 
@@ -59,9 +68,10 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -69,21 +79,23 @@ uint64
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
   argaddr(1, &p);
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
   
   argaddr(1, &p);
@@ -91,7 +103,9 @@ sys_write(void)
   if(argfd(0, 0, &f) < 0)
     return -1;
 
-  return filewrite(f, p, n);
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
@@ -99,10 +113,21 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
 
-  if(argfd(0, &fd, &f) < 0)
+  // take it out of the table under the leader's lock, as
+  // fdfile() reads it.
+  argint(0, &fd);
+  if(fd < 0 || fd >= NOFILE)
+    return -1;
+  acquire(&l->lock);
+  if((f = p->ofile[fd]) == 0){
+    release(&l->lock);
     return -1;
-  myproc()->ofile[fd] = 0;
+  }
+  p->ofile[fd] = 0;
+  release(&l->lock);
   fileclose(f);
   return 0;
 }
@@ -112,11 +137,43 @@ sys_fstat(void)
 {
   struct file *f;
   uint64 st; // user pointer to struct stat
+  int r;
 
   argaddr(1, &st);
   if(argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
+}
+
+// wait for any of several files to be ready.
+uint64
+sys_poll(void)
+{
+  uint64 fds;
+  int n, timeout;
+
+  argaddr(0, &fds);
+  argint(1, &n);
+  argint(2, &timeout);
+  return poll(fds, n, timeout);
+}
+
+// get or set a file's flags.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg, r;
+
+  argint(1, &cmd);
+  argint(2, &arg);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  r = filefcntl(f, cmd, arg);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -352,6 +409,8 @@ sys_open(void)
   if(ip->type == T_DEVICE){
     f->type = FD_DEVICE;
     f->major = ip->major;
+    f->minor = ip->minor;
+    f->off = 0;
   } else {
     f->type = FD_INODE;
     f->off = 0;
@@ -359,6 +418,7 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
@@ -503,3 +563,33 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// map a file into memory.
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len, r;
+  int prot, flags, off;
+  struct file *f;
+
+  argaddr(0, &addr);   // placement hint, ignored
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argint(5, &off);
+  if(off < 0 || argfd(4, 0, &f) < 0)
+    return -1;
+  r = mmap(len, prot, flags, f, off);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  return munmap(addr, len);
+}
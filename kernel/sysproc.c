@@ -6,6 +6,8 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "superpages.h"
+#include "time.h"
+#include "syscall.h"
 
 uint64
 sys_exit(void)
@@ -39,7 +41,7 @@ sys_wait(void)
 uint64
 sys_sbrk(void)
 {
-  uint64 addr = myproc()->sz;
+  uint64 addr = myproc()->leader->sz;
   int n = 0;
   int superpage_size = 2 * 1024 * 1024; // 2MB
 
@@ -54,26 +56,37 @@ sys_sbrk(void)
   return (growproc(total_size) < 0) ? -1 : addr; // Avoid early returns
 }
 
+// sleep for n ticks, measured from now rather than
+// from the last tick boundary.
 uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
   if(n < 0)
     n = 0;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return sleepuntil(r_time() + (uint64)n * TICKCYCLES);
+}
+
+uint64
+sys_nanosleep(void)
+{
+  uint64 uts, now;
+  struct timespec ts;
+
+  argaddr(0, &uts);
+  if(copyin(myproc()->pagetable, (char *)&ts, uts, sizeof(ts)) < 0)
+    return -1;
+  if(ts.tv_nsec >= 1000000000 || (long)ts.tv_sec < 0)
+    return -1;
+  // a deadline the time CSR can't reach means sleep until killed,
+  // rather than letting tv_sec * TIMEBASE wrap around.
+  now = r_time();
+  if(ts.tv_sec >= (~0ULL - now) / TIMEBASE)
+    return sleepuntil(~0ULL);
+  return sleepuntil(now + ts.tv_sec * TIMEBASE +
+                    ts.tv_nsec / (1000000000 / TIMEBASE));
 }
 
 uint64
@@ -90,11 +103,222 @@ sys_kill(void)
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return r_time() / TICKCYCLES;
+}
+
+// read a clock at the resolution of the time CSR.
+uint64
+sys_clock_gettime(void)
+{
+  int clk;
+  uint64 uts, t;
+  struct timespec ts;
+
+  argint(0, &clk);
+  argaddr(1, &uts);
+  if(clk != CLOCK_MONOTONIC)
+    return -1;
+  t = r_time();
+  ts.tv_sec = t / TIMEBASE;
+  ts.tv_nsec = (t % TIMEBASE) * (1000000000 / TIMEBASE);
+  if(copyout(myproc()->pagetable, uts, (char *)&ts, sizeof(ts)) < 0)
+    return -1;
+  return 0;
+}
+
+// read the calling thread's share of the hardware counters.
+uint64
+sys_getcounters(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return getcounters(addr);
+}
+
+// turn the calling thread's fast system call path on or off,
+// to compare the two.
+uint64
+sys_fastcalls(void)
+{
+  int on;
+
+  argint(0, &on);
+  myproc()->trapframe->fastcalls = on ? FASTCALLS : 0;
+  return 0;
+}
+
+// copy out the kernel log.
+uint64
+sys_dmesg(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return dmesg(addr, n);
+}
+
+// make a batched system call ring the process's.
+uint64
+sys_ringsetup(void)
+{
+  uint64 addr;
+  int size;
+
+  argaddr(0, &addr);
+  argint(1, &size);
+  return ringsetup(addr, size);
+}
+
+// carry out entries of the process's ring.
+uint64
+sys_ringenter(void)
+{
+  int n;
+
+  argint(0, &n);
+  return ringenter(n);
+}
+
+// set the scheduling class and priority of a process.
+uint64
+sys_setpriority(void)
+{
+  int pid, policy, prio;
+
+  argint(0, &pid);
+  argint(1, &policy);
+  argint(2, &prio);
+  return setpriority(pid, policy, prio);
+}
+
+// adjust the caller's nice value, returning the new one.
+uint64
+sys_nice(void)
+{
+  int incr;
+
+  argint(0, &incr);
+  return nice(incr);
+}
+
+// start a thread running fn(arg) on the given stack.
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  argaddr(0, &fn);
+  argaddr(1, &arg);
+  argaddr(2, &stack);
+  return clone(fn, arg, stack);
+}
+
+// wait for a thread to exit, returning its stack.
+uint64
+sys_join(void)
+{
+  int tid;
+  uint64 p;
+
+  argint(0, &tid);
+  argaddr(1, &p);
+  return join(tid, p);
+}
+
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  argaddr(0, &addr);
+  argint(1, &op);
+  argint(2, &val);
+  return futex(addr, op, val);
+}
+
+// find or create a shared memory segment.
+uint64
+sys_shmget(void)
+{
+  int key, size;
+
+  argint(0, &key);
+  argint(1, &size);
+  return shmget(key, size);
+}
+
+uint64
+sys_shmat(void)
+{
+  int id;
+
+  argint(0, &id);
+  return shmat(id);
+}
+
+uint64
+sys_shmdt(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return shmdt(addr);
+}
+
+uint64
+sys_shmrm(void)
+{
+  int id;
+
+  argint(0, &id);
+  return shmrm(id);
+}
+
+// copy paging statistics to a struct swapstat.
+uint64
+sys_swapstat(void)
+{
+  uint64 addr;
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  argaddr(0, &addr);
+  return swapstat(addr);
 }
 
+// start sampling at a rate, or stop if it is 0.
+uint64
+sys_profctl(void)
+{
+  int hz;
+
+  argint(0, &hz);
+  return profctl(hz);
+}
+
+// drain profiler samples to a struct profsample array.
+uint64
+sys_profread(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return profread(addr, n);
+}
+
+// copy system call statistics, for everything or one pid.
+uint64
+sys_sysstat(void)
+{
+  int pid, n;
+  uint64 addr;
+
+  argint(0, &pid);
+  argaddr(1, &addr);
+  argint(2, &n);
+  return sysstat(pid, addr, n);
+}
@@ -0,0 +1,6 @@
+// Per-system-call statistics, from sysstat().
+struct sysstat {
+  uint64 count;      // calls
+  uint64 time;       // total time in the call, in time CSR cycles
+  uint64 max;        // longest call, in time CSR cycles
+};
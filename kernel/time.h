@@ -0,0 +1,17 @@
+// Clocks, for clock_gettime() and nanosleep().
+#define CLOCK_MONOTONIC 1   // time since boot, from the time CSR
+
+struct timespec {
+  uint64 tv_sec;
+  uint64 tv_nsec;
+};
+
+// A thread's own share of the hardware counters, from
+// getcounters(): counted only while it runs, in user or kernel
+// mode. User code can also read the raw cycle, time and instret
+// CSRs, which count for the whole hart.
+struct counters {
+  uint64 cycles;     // cycle CSR
+  uint64 instret;    // instructions retired
+  uint64 time;       // time CSR, TIMEBASE per second
+};
@@ -5,16 +5,22 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "syscall.h"
 
 struct spinlock tickslock;
 uint ticks;
 
+// earliest deadline of any process in sleepuntil(), in time CSR
+// cycles, or ~0 if none. protected by tickslock.
+uint64 nexttimer = ~0ULL;
+
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
 void kernelvec();
 
 extern int devintr();
+extern int profhz;
 
 void
 trapinit(void)
@@ -29,6 +35,25 @@ trapinithart(void)
   w_stvec((uint64)kernelvec);
 }
 
+// an instruction, load or store page fault from user space.
+// map the page if it is one that is filled in lazily, else kill p.
+static void
+pagefault(struct proc *p)
+{
+  uint64 scause = r_scause();
+  uint64 va = r_stval();
+
+  // an interrupt will change scause and stval, so enable
+  // only now; filling the page may sleep.
+  intr_on();
+
+  if(vmfault(p->pagetable, va, scause == 15) < 0){
+    printf("usertrap(): page fault scause 0x%lx pid=%d\n", scause, p->pid);
+    printf("            sepc=0x%lx stval=0x%lx\n", p->trapframe->epc, va);
+    setkilled(p);
+  }
+}
+
 //
 // handle an interrupt, exception, or system call from user space.
 // called from trampoline.S
@@ -65,6 +90,8 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    pagefault(p);
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -83,6 +110,46 @@ usertrap(void)
   usertrapret();
 }
 
+// handle a system call in the trapframe's fastcalls, from the
+// fast path in trampoline.S. it saved only ra, sp, gp, tp and
+// a0-a7, and called this as a function: the user's s registers
+// are still in place when this returns, by the calling
+// convention. returns what userret gets from usertrapret().
+struct fastret
+usertrap_fast(void)
+{
+  struct proc *p = myproc();
+  struct fastret r;
+  int num = p->trapframe->a7;
+
+  w_stvec((uint64)kernelvec);
+
+  // return to the instruction after the ecall.
+  p->trapframe->epc = r_sepc() + 4;
+
+  if(killed(p))
+    exit(-1);
+
+  if((NOINTRCALLS & SYSBIT(num)) == 0)
+    intr_on();
+
+  syscall();
+
+  if(killed(p))
+    exit(-1);
+
+  // as usertrapret(), less what doesn't change between calls.
+  intr_off();
+  w_stvec(TRAMPOLINE + (uservec - trampoline));
+  p->trapframe->kernel_hartid = r_tp();  // it may have moved
+  w_sstatus((r_sstatus() & ~SSTATUS_SPP) | SSTATUS_SPIE);
+  w_sepc(p->trapframe->epc);
+
+  r.satp = MAKE_SATP(p->pagetable);
+  r.trapframe = THREADFRAME(p->tslot);
+  return r;
+}
+
 //
 // return to user space
 //
@@ -105,6 +172,7 @@ usertrapret(void)
   p->trapframe->kernel_satp = r_satp();         // kernel page table
   p->trapframe->kernel_sp = p->kstack + PGSIZE; // process's kernel stack
   p->trapframe->kernel_trap = (uint64)usertrap;
+  p->trapframe->kernel_fasttrap = (uint64)usertrap_fast;
   p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
 
   // set up the registers that trampoline.S's sret will use
@@ -119,14 +187,16 @@ usertrapret(void)
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
-  // tell trampoline.S the user page table to switch to.
+  // tell trampoline.S the user page table to switch to,
+  // and where this thread's trapframe is mapped in it.
   uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 trapframe = THREADFRAME(p->tslot);
 
   // jump to userret in trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64))trampoline_userret)(satp);
+  ((void (*)(uint64, uint64))trampoline_userret)(satp, trapframe);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -160,26 +230,113 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// Program this CPU's next timer interrupt. A CPU running a
+// process needs a tick to preempt it at c->tickdue, and more
+// frequent ones if the profiler is on; an idle CPU only needs
+// to wake for the next sleepuntil() deadline, so it is left
+// alone until then (tickless idle); wakeidle() interrupts it
+// if there is work sooner. Interrupts must be off.
+void
+timerset(void)
+{
+  struct cpu *c = mycpu();
+  uint64 next;
+  int hz;
+
+  next = nexttimer;
+  if(c->proc != 0){
+    if(c->tickdue < next)
+      next = c->tickdue;
+    if((hz = profhz) != 0 && r_time() + TIMEBASE/hz < next)
+      next = r_time() + TIMEBASE/hz;
+  }
+
+  // writing stimecmp also clears the pending interrupt request.
+  w_stimecmp(next);
+}
+
+// Interrupt hart, which takes it as a supervisor software
+// interrupt. Interrupts already requested and not yet taken
+// are taken once.
 void
+sendipi(int hart)
+{
+  *(volatile uint32*)CLINT_MSIP(hart) = 1;
+}
+
+// Handle a timer interrupt. Returns 1 if the running
+// process should yield: its tick is up, or a sleepuntil()
+// deadline passed and woke someone who may deserve the CPU.
+int
 clockintr()
 {
-  if(cpuid() == 0){
-    acquire(&tickslock);
-    ticks++;
+  struct cpu *c = mycpu();
+  uint64 now = r_time();
+  int preempt = 0;
+
+  // ticks is derived from the time CSR rather than counted,
+  // so it stays correct whichever CPUs take timer interrupts.
+  acquire(&tickslock);
+  if(now / TICKCYCLES != ticks){
+    ticks = now / TICKCYCLES;
     wakeup(&ticks);
-    release(&tickslock);
   }
+  if(now >= nexttimer){
+    // the sleepers and pollers re-arm any deadlines that are
+    // still pending.
+    nexttimer = ~0ULL;
+    wakeup(&nexttimer);
+    pollwakeup();
+    preempt = 1;
+  }
+  release(&tickslock);
 
-  // ask for the next timer interrupt. this also clears
-  // the interrupt request. 1000000 is about a tenth
-  // of a second.
-  w_stimecmp(r_time() + 1000000);
+  if(c->proc != 0 && now >= c->tickdue){
+    c->tickdue = now + TICKCYCLES;
+    preempt = 1;
+  }
+
+  // sepc and sstatus still describe the interrupted code.
+  if(profhz)
+    profsample(r_sepc(), (r_sstatus() & SSTATUS_SPP) == 0);
+
+  timerset();
+  return preempt;
+}
+
+// Sleep until the time CSR reaches deadline.
+// Returns 0, or -1 if the process was killed.
+int
+sleepuntil(uint64 deadline)
+{
+  acquire(&tickslock);
+  while(r_time() < deadline){
+    if(killed(myproc())){
+      release(&tickslock);
+      return -1;
+    }
+    if(deadline < nexttimer)
+      nexttimer = deadline;
+    sleep(&nexttimer, &tickslock);
+  }
+  release(&tickslock);
+  return 0;
+}
+
+// Have a timer interrupt by deadline call pollwakeup().
+void
+timeralarm(uint64 deadline)
+{
+  acquire(&tickslock);
+  if(deadline < nexttimer)
+    nexttimer = deadline;
+  release(&tickslock);
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
-// 1 if other device,
+// returns 2 if timer interrupt that should preempt,
+// 1 if other device or another timer interrupt,
 // 0 if not recognized.
 int
 devintr()
@@ -209,8 +366,15 @@ devintr()
     return 1;
   } else if(scause == 0x8000000000000005L){
     // timer interrupt.
-    clockintr();
-    return 2;
+    return clockintr() ? 2 : 1;
+  } else if(scause == 0x8000000000000001L){
+    // software interrupt from another hart's sendipi(),
+    // by way of ipivec: to wake the hart, or to flush its
+    // TLB for tlbshootdown(), which counts on nipi.
+    w_sip(r_sip() & ~SIE_SSIE);
+    sfence_vma();
+    __atomic_store_n(&mycpu()->nipi, mycpu()->nipi + 1, __ATOMIC_RELEASE);
+    return 1;
   } else {
     return 0;
   }
@@ -38,12 +38,17 @@
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
-// the transmit output buffer.
+#define UART_FIFO 16          // transmit FIFO bytes, all free when LSR_TX_IDLE
+
+// the transmit output buffer, for both write()s to the console
+// and the kernel's printf(). uartstart() refills the UART's
+// FIFO from it whenever the UART reports it empty.
 struct spinlock uart_tx_lock;
-#define UART_TX_BUF_SIZE 32
+#define UART_TX_BUF_SIZE 4096
 char uart_tx_buf[UART_TX_BUF_SIZE];
 uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
 uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
+int uart_tx_wake; // uartstart() made room in a full buffer; uartintr() wakes the waiters
 
 extern volatile int panicked; // from printf.c
 
@@ -77,14 +82,41 @@ uartinit(void)
   initlock(&uart_tx_lock, "uart");
 }
 
-// add a character to the output buffer and tell the
+// add n characters to the output buffer and tell the
 // UART to start sending if it isn't already.
-// blocks if the output buffer is full.
+// blocks while the output buffer is full.
 // because it may block, it can't be called
 // from interrupts; it's only suitable for use
 // by write().
 void
-uartputc(int c)
+uartputs(char *s, int n)
+{
+  acquire(&uart_tx_lock);
+
+  if(panicked){
+    for(;;)
+      ;
+  }
+  while(n > 0){
+    if(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+      // buffer is full.
+      // wait for uartstart() to open up space in the buffer.
+      sleep(&uart_tx_r, &uart_tx_lock);
+      continue;
+    }
+    uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = *s++;
+    uart_tx_w += 1;
+    n--;
+  }
+  uartstart();
+  release(&uart_tx_lock);
+}
+
+// add n characters to the output buffer, for the kernel:
+// never sleeps, so it can be called from interrupts. if the
+// buffer is full, it waits for the UART itself.
+void
+uartputs_kernel(char *s, int n)
 {
   acquire(&uart_tx_lock);
 
@@ -92,22 +124,66 @@ uartputc(int c)
     for(;;)
       ;
   }
-  while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
-    // buffer is full.
-    // wait for uartstart() to open up space in the buffer.
-    sleep(&uart_tx_r, &uart_tx_lock);
+  while(n > 0){
+    if(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+      uartstart();
+      continue;
+    }
+    uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = *s++;
+    uart_tx_w += 1;
+    n--;
   }
-  uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = c;
-  uart_tx_w += 1;
   uartstart();
   release(&uart_tx_lock);
 }
 
+// add as many of n characters to the output buffer as fit,
+// without waiting. returns how many.
+int
+uartputs_nowait(char *s, int n)
+{
+  int i;
+
+  acquire(&uart_tx_lock);
+  for(i = 0; i < n && uart_tx_w != uart_tx_r + UART_TX_BUF_SIZE; i++){
+    uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = s[i];
+    uart_tx_w += 1;
+  }
+  uartstart();
+  release(&uart_tx_lock);
+  return i;
+}
+
+// is there room in the output buffer?
+int
+uartwritable(void)
+{
+  int r;
+
+  acquire(&uart_tx_lock);
+  r = uart_tx_w != uart_tx_r + UART_TX_BUF_SIZE;
+  release(&uart_tx_lock);
+  return r;
+}
+
+// send what is in the output buffer with interrupts off and
+// without the lock, for panic(): whoever holds it may never
+// let go.
+void
+uartflush_sync(void)
+{
+  while(uart_tx_r != uart_tx_w){
+    while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+      ;
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
+    uart_tx_r += 1;
+  }
+}
+
 
-// alternate version of uartputc() that doesn't 
-// use interrupts, for use by kernel printf() and
-// to echo characters. it spins waiting for the uart's
-// output register to be empty.
+// alternate version of uartputs() that doesn't
+// use interrupts, for use by panic(). it spins
+// waiting for the uart's output register to be empty.
 void
 uartputc_sync(int c)
 {
@@ -126,35 +202,41 @@ uartputc_sync(int c)
   pop_off();
 }
 
-// if the UART is idle, and a character is waiting
-// in the transmit buffer, send it.
+// if the UART is idle, and characters are waiting
+// in the transmit buffer, fill its FIFO with them.
 // caller must hold uart_tx_lock.
 // called from both the top- and bottom-half.
 void
 uartstart()
 {
-  while(1){
-    if(uart_tx_w == uart_tx_r){
-      // transmit buffer is empty.
-      ReadReg(ISR);
-      return;
-    }
-    
-    if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
-      // the UART transmit holding register is full,
-      // so we cannot give it another byte.
-      // it will interrupt when it's ready for a new byte.
-      return;
-    }
-    
-    int c = uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE];
+  int i, full;
+
+  if(uart_tx_w == uart_tx_r){
+    // transmit buffer is empty.
+    ReadReg(ISR);
+    return;
+  }
+
+  if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
+    // the UART is still sending the last batch.
+    // it will interrupt when its FIFO is empty.
+    return;
+  }
+
+  // LSR_TX_IDLE means the whole FIFO is free.
+  full = uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE;
+  for(i = 0; i < UART_FIFO && uart_tx_r != uart_tx_w; i++){
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
     uart_tx_r += 1;
-    
-    // maybe uartputc() is waiting for space in the buffer.
-    wakeup(&uart_tx_r);
-    
-    WriteReg(THR, c);
   }
+
+  // maybe uartputs() is waiting for space in the buffer,
+  // or poll() for the console to be writable. not woken
+  // here: printf() gets here holding any lock at all, and
+  // wakeup() takes p->lock. the UART interrupts when its
+  // FIFO empties, and uartintr() wakes them.
+  if(full)
+    uart_tx_wake = 1;
 }
 
 // read one input character from the UART.
@@ -187,5 +269,13 @@ uartintr(void)
   // send buffered characters.
   acquire(&uart_tx_lock);
   uartstart();
+  if(uart_tx_wake){
+    uart_tx_wake = 0;
+    wakeup(&uart_tx_r);
+    pollwakeup();
+  }
   release(&uart_tx_lock);
+
+  // and the kernel log's, now there may be room.
+  klogdrain();
 }
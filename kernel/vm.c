@@ -3,10 +3,10 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "kalloc.h"
-// Define PTE_PS for superpage
-#define PTE_PS (1L << 7)
 #include "fs.h"
 #include <stdio.h>
 
@@ -34,6 +34,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT software interrupt registers, for sendipi()
+  kvmmap(kpgtbl, CLINT, CLINT, PGSIZE, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x4000000, PTE_R | PTE_W);
 
@@ -47,9 +50,6 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // allocate and map a kernel stack for each process.
-  proc_mapstacks(kpgtbl);
-  
   return kpgtbl;
 }
 
@@ -97,9 +97,8 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
     if(*pte & PTE_V){
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable2 = (pde_t *)kalloc()) == 0)
+      if(!alloc || (pagetable2 = (pde_t *)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable2, 0, PGSIZE);
       *pte = PA2PTE(pagetable2) | PTE_V;
       pagetable = pagetable2;
     }
@@ -137,6 +136,67 @@ uint64 walkaddr(pagetable_t pagetable, uint64 va) {
   return pa;
 }
 
+// Handle a fault on va in pagetable, which the current process
+// touched for reading or writing, by mapping a page that is
+// allowed there but not yet present.
+// Returns 0 if va is now mapped, or -1 if the access is invalid.
+int
+vmfault(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+
+  // filling a page may sleep, so not from a copyout()
+  // made with a spinlock held.
+  if(p == 0 || pagetable != p->pagetable || va >= MAXVA || !intr_get())
+    return -1;
+  if((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_SWAP))
+    return swapin(p, va);
+  swapminfault();
+  if(va < p->leader->sz)
+    return execfault(p, va, write);
+  return mmapfault(p, va, write);
+}
+
+// Fault in the pages of [va, va+len) in the current process,
+// for a copyout() or copyin() that will be made holding a
+// spinlock and so can't fill pages itself. The caller may sleep
+// before the copy, so the range stays pinned against swapout()
+// until the system call returns. Callers fault in only what
+// they are about to copy, so a short transfer into a large
+// buffer doesn't fill pages it never touches.
+// Returns how many bytes from va on are mapped: len, or fewer
+// if some page can't be, and 0 if the first can't.
+int
+uvmprefault(uint64 va, uint64 len, int write)
+{
+  struct proc *p = myproc();
+  pagetable_t pagetable = p->pagetable;
+  uint64 a;
+  pte_t *pte;
+  struct pin *pin;
+
+  if(va >= MAXVA || len > MAXVA - va)
+    return 0;
+  // earlier pins of the call stay; past NPIN, everything is.
+  pin = p->npins < NPIN ? &p->pins[p->npins] : 0;
+  p->npins++;
+  if(pin){
+    pin->va = va;
+    pin->len = len;
+  }
+  for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE){
+    pte = walk(pagetable, a, 0);
+    if((pte == 0 || (*pte & PTE_V) == 0) && vmfault(pagetable, a, write) < 0){
+      len = a > va ? a - va : 0;
+      if(pin)
+        pin->len = len;
+      break;
+    }
+  }
+  return len;
+}
+
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
@@ -208,7 +268,7 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm, int
   return 0;
 }
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that were never faulted in are skipped.
 // Optionally free the physical memory.
 void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free) {
   uint64 a, pa;
@@ -220,10 +280,15 @@ void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free) {
 
   for (a = va; a < end; ) {
     pte = walk(pagetable, a, 0);
-    if (pte == 0)
-      panic("uvmunmap: walk");
-    if ((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+    if (pte && (*pte & PTE_SWAP)) {
+      swapfree(PTE2SLOT(*pte));
+      *pte = 0;
+    }
+    if (pte == 0 || (*pte & PTE_V) == 0) {
+      // never faulted in, or swapped out.
+      a += PGSIZE;
+      continue;
+    }
     if (PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
 
@@ -243,16 +308,85 @@ void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free) {
   }
 }
 
+// Flush the TLBs of the other harts running one of l's threads,
+// after unmapping pages from the page table they share, so that
+// the pages can be freed: interrupt each, and wait until it has
+// taken the interrupt. Interrupts must be on and no spinlock
+// held, since the hart waited for may be waiting for this one.
+void
+tlbshootdown(struct proc *l)
+{
+  uint64 seen[NCPU];
+  struct proc *q;
+  int i, me, wait;
+
+  __sync_synchronize();  // the cleared PTEs first
+  wait = 0;
+  push_off();  // q stays valid; see allproc in proc.c
+  me = cpuid();
+  for(i = 0; i < NCPU; i++){
+    if(i != me && (q = cpus[i].proc) != 0 && q->leader == l){
+      seen[i] = __atomic_load_n(&cpus[i].nipi, __ATOMIC_ACQUIRE);
+      sendipi(i);
+      wait |= 1 << i;
+    }
+  }
+  pop_off();
+  sfence_vma();
+
+  for(i = 0; i < NCPU; i++)
+    if(wait & (1 << i))
+      while(__atomic_load_n(&cpus[i].nipi, __ATOMIC_ACQUIRE) == seen[i])
+        ;
+}
+
+// Like uvmunmap(l->pagetable, va, (end-va)/PGSIZE, 1), for a page
+// table that l's threads may be using on other harts: the pages
+// are freed in batches, each after a tlbshootdown(). Nothing may
+// map pages into the range meanwhile. Takes l->vmlock.
+#define NUNMAP 16
+void
+uvmunmapshared(struct proc *l, uint64 va, uint64 end)
+{
+  uint64 pa[NUNMAP];
+  pte_t *pte;
+  int i, n;
+
+  while(va < end){
+    n = 0;
+    acquire(&l->vmlock);
+    while(va < end && n < NUNMAP){
+      pte = walk(l->pagetable, va, 0);
+      if(pte && (*pte & PTE_SWAP)){
+        swapfree(PTE2SLOT(*pte));
+        *pte = 0;
+      }
+      if(pte == 0 || (*pte & PTE_V) == 0){
+        va += PGSIZE;
+        continue;
+      }
+      if(PTE_FLAGS(*pte) == PTE_V)
+        panic("uvmunmapshared: not a leaf");
+      pa[n++] = PTE2PA(*pte);
+      va += (*pte & PTE_PS) ? 2 * 1024 * 1024 : PGSIZE;  // 2MB superpage
+      *pte = 0;
+    }
+    release(&l->vmlock);
+    tlbshootdown(l);
+    for(i = 0; i < n; i++)
+      kfree((void*)pa[i]);
+  }
+}
+
 // create an empty user page table.
 // returns 0 if out of memory.
 pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -266,8 +400,7 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("uvmfirst: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U, PGSIZE);
   memmove(mem, src, sz);
 }
@@ -295,7 +428,7 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
               fflush(stdout);
               break; // Avoid partial allocation
           }
-          memset(mem, 0, superpage_size);
+          // superalloc() has zeroed it.
           if (mappages(pagetable, a, superpage_size, (uint64)mem, PTE_R | PTE_U | xperm, superpage_size) != 0) {
               printf("mappages failed for superpage at va: %p\n", (void*)a);
               fflush(stdout);
@@ -307,13 +440,12 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
           a += superpage_size - PGSIZE; // Move ahead by the remaining size of the superpage
       } else {
           // Allocate regular 4KB page
-          mem = kalloc();
+          mem = kalloc_zeroed();
           if (!mem) {
               printf("kalloc failed at va: %p\n", (void*)a);
               fflush(stdout);
               break;
           }
-          memset(mem, 0, PGSIZE);
           if (mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R | PTE_U | xperm, PGSIZE) != 0) {
               printf("mappages failed for 4KB page at va: %p\n", (void*)a);
               fflush(stdout);
@@ -391,6 +523,25 @@ void freewalk(pagetable_t pagetable)
   kfree((void*)pagetable);
 }
 
+// Count the pages of a user page table, for /proc/procs:
+// page-table pages in pt[0], mapped user pages in pt[1] (a
+// superpage counts as 512), and swapped-out pages in pt[2].
+// The leader's vmlock must be held.
+void
+uvmcount(pagetable_t pagetable, uint64 *pt)
+{
+  pt[0]++;
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0)
+      uvmcount((pagetable_t)PTE2PA(pte), pt);
+    else if((pte & PTE_V) && (pte & PTE_U))
+      pt[1] += (pte & PTE_PS) ? 512 : 1;
+    else if(pte & PTE_SWAP)
+      pt[2]++;
+  }
+}
+
 // Free user memory pages,
 // then free page-table pages.
 void
@@ -404,7 +555,8 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 // Given a parent process's page table, copy
 // its memory into a child's page table.
 // Copies both the page table and the
-// physical memory.
+// physical memory, except that read-only
+// pages such as program text are shared.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz) {
@@ -415,10 +567,21 @@ int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz) {
   uint64 pagesize;
 
   for (i = 0; i < sz; i += pagesize) {
+    pagesize = PGSIZE;
     if ((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+      continue;
+    if (*pte & PTE_SWAP) {
+      // the child shares the swap slot; whoever faults first
+      // reads a private copy.
+      pte_t *npte;
+      if ((npte = walk(new, i, 1)) == 0)
+        goto err;
+      swapdup(PTE2SLOT(*pte));
+      *npte = *pte;
+      continue;
+    }
     if ((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+      continue;  // not faulted in yet; the child will fault it itself.
 
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
@@ -426,6 +589,12 @@ int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz) {
     pagesize = PGSIZE; // Default to 4KB
     if (*pte & PTE_PS) {
       pagesize = 2 * 1024 * 1024; // 2MB Superpage
+    } else if ((flags & PTE_W) == 0) {
+      // nobody can write it, so parent and child can share it.
+      if (mappages(new, i, PGSIZE, pa, flags, PGSIZE) != 0)
+        goto err;
+      krefinc((void*)pa);
+      continue;
     }
 
     // Allocate the correct size
@@ -470,9 +639,19 @@ int copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len) {
   while (len > 0) {
     va0 = PGROUNDDOWN(dstva);
     pte = walk(pagetable, va0, 0);
-    if (pte == 0 || (*pte & PTE_V) == 0)
+    if (pte == 0 || (*pte & PTE_V) == 0) {
+      if (vmfault(pagetable, va0, 1) < 0)
+        return -1;
+      continue;
+    }
+    // only where the user could store itself: text and read-only
+    // mappings may be page-cache pages shared with other
+    // processes, and the USYSCALL page is the kernel's.
+    if ((*pte & (PTE_U | PTE_W)) != (PTE_U | PTE_W))
       return -1;
 
+    // the hardware only sees user-mode writes.
+    *pte |= PTE_A | PTE_D;
     pa = PTE2PA(*pte);
     pagesize = (*pte & PTE_PS) ? (2 * 1024 * 1024) : PGSIZE;  // Detect 2MB page
     n = pagesize - (dstva - va0);
@@ -499,8 +678,11 @@ int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len) {
   while (len > 0) {
     va0 = PGROUNDDOWN(srcva);
     pte = walk(pagetable, va0, 0);
-    if (pte == 0 || (*pte & PTE_V) == 0)
-      return -1;
+    if (pte == 0 || (*pte & PTE_V) == 0) {
+      if (vmfault(pagetable, va0, 0) < 0)
+        return -1;
+      continue;
+    }
 
     pa = PTE2PA(*pte);
     pagesize = (*pte & PTE_PS) ? (2 * 1024 * 1024) : PGSIZE;
@@ -528,8 +710,11 @@ int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max) {
   while (got_null == 0 && max > 0) {
     va0 = PGROUNDDOWN(srcva);
     pte_t *pte = walk(pagetable, va0, 0);
-    if (pte == 0 || (*pte & PTE_V) == 0)
-      return -1;
+    if (pte == 0 || (*pte & PTE_V) == 0) {
+      if (vmfault(pagetable, va0, 0) < 0)
+        return -1;
+      continue;
+    }
 
     pa0 = PTE2PA(*pte);
     pagesize = (*pte & PTE_PS) ? (2 * 1024 * 1024) : PGSIZE;
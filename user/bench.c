@@ -0,0 +1,83 @@
+// Benchmark timing.
+//
+// benchstart() and benchstop() bracket a measured region; the
+// counts come from getcounters(), so time spent by other
+// processes while this one was preempted doesn't count. Wall
+// time comes from the time CSR, which user code reads directly.
+// bench() times iters calls of a function after one warm-up
+// call, and prints the costs per call.
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "kernel/time.h"
+#include "user/user.h"
+
+void
+benchstart(struct bench *b, char *name)
+{
+  struct counters c;
+
+  b->name = name;
+  b->iters = 0;
+  getcounters(&c);
+  b->cycles = c.cycles;
+  b->instret = c.instret;
+  b->time = c.time;
+  b->wall = r_time();
+}
+
+void
+benchstop(struct bench *b, int iters)
+{
+  struct counters c;
+
+  b->wall = r_time() - b->wall;
+  getcounters(&c);
+  b->cycles = c.cycles - b->cycles;
+  b->instret = c.instret - b->instret;
+  b->time = c.time - b->time;
+  b->iters = iters;
+}
+
+// print n/d with two decimals.
+static void
+printdiv(uint64 n, uint64 d)
+{
+  uint64 x;
+
+  if(d == 0)
+    d = 1;
+  x = n * 100 / d;
+  printf("%ld.%ld%ld", x / 100, x / 10 % 10, x % 10);
+}
+
+void
+benchprint(struct bench *b)
+{
+  uint64 n = b->iters > 0 ? b->iters : 1;
+
+  printf("%s: %d iters, cycles/iter ", b->name, b->iters);
+  printdiv(b->cycles, n);
+  printf(", instrs/iter ");
+  printdiv(b->instret, n);
+  printf(", IPC ");
+  printdiv(b->instret, b->cycles);
+  printf(", ns/iter ");
+  // the time CSR ticks TIMEBASE (10MHz) times a second.
+  printdiv(b->wall * 100, n);
+  printf("\n");
+}
+
+void
+bench(char *name, void (*fn)(void*), void *arg, int iters)
+{
+  struct bench b;
+  int i;
+
+  fn(arg);
+  benchstart(&b, name);
+  for(i = 0; i < iters; i++)
+    fn(arg);
+  benchstop(&b, iters);
+  benchprint(&b);
+}
@@ -0,0 +1,58 @@
+// callbench: time system call round trips through the fast
+// trap path and, with fastcalls(0), through the full one.
+//   callbench [iters]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+static int fds[2];
+
+static void
+nullcall(void *arg)
+{
+  trap_getpid();
+}
+
+static void
+statcall(void *arg)
+{
+  struct stat st;
+
+  fstat(fds[0], &st);
+}
+
+static void
+pipecall(void *arg)
+{
+  char c = 0;
+
+  write(fds[1], &c, 1);
+  read(fds[0], &c, 1);
+}
+
+static void
+run(int iters)
+{
+  bench("getpid", nullcall, 0, iters);
+  bench("fstat", statcall, 0, iters);
+  bench("pipe write+read", pipecall, 0, iters);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int iters = argc > 1 ? atoi(argv[1]) : 10000;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "callbench: pipe failed\n");
+    exit(1);
+  }
+  printf("fast path:\n");
+  fastcalls(1);
+  run(iters);
+  printf("full path:\n");
+  fastcalls(0);
+  run(iters);
+  exit(0);
+}
@@ -0,0 +1,36 @@
+// dmesg: print the kernel log, each line with the time since
+// boot it was printed at and the CPU that printed it.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/klog.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct klogrec *r;
+  uint64 us;
+  char digits[7];
+  int i, j, n;
+
+  if((r = malloc(NKLOG * sizeof(*r))) == 0){
+    fprintf(2, "dmesg: out of memory\n");
+    exit(1);
+  }
+  if((n = dmesg(r, NKLOG)) < 0){
+    fprintf(2, "dmesg: failed\n");
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(r[i].line){
+      us = r[i].time % TIMEBASE * 1000000 / TIMEBASE;
+      for(j = 5; j >= 0; j--, us /= 10)
+        digits[j] = '0' + us % 10;
+      digits[6] = 0;
+      printf("[%d.%s] cpu%d: ", (int)(r[i].time / TIMEBASE), digits, r[i].cpu);
+    }
+    write(1, r[i].text, r[i].n);
+  }
+  exit(0);
+}
@@ -1,11 +1,12 @@
 // Test that fork fails gracefully.
-// Tiny executable so that the limit can be filling the proc table.
+// There is no fixed limit on processes, so this runs the
+// kernel out of memory for them.
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
 
-#define N  1000
+#define N  10000
 
 void
 print(const char *s)
@@ -11,6 +11,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/ring.h"
 
 // from FreeBSD.
 int
@@ -52,9 +53,14 @@ go(int which_child)
 {
   int fd = -1;
   static char buf[999];
+  struct ring *r = ringalloc(8);
   char *break0 = sbrk(0);
   uint64 iters = 0;
 
+  if(r == 0){
+    printf("grind: ringalloc failed\n");
+    exit(1);
+  }
   mkdir("grindir");
   if(chdir("grindir") != 0){
     printf("grind: chdir grindir failed\n");
@@ -66,7 +72,7 @@ go(int which_child)
     iters++;
     if((iters % 500) == 0)
       write(1, which_child?"B":"A", 1);
-    int what = rand() % 23;
+    int what = rand() % 24;
     if(what == 1){
       close(open("grindir/../a", O_CREATE|O_RDWR));
     } else if(what == 2){
@@ -289,6 +295,25 @@ go(int which_child)
         printf("grind: exec pipeline failed %d %d \"%s\"\n", st1, st2, buf);
         exit(1);
       }
+    } else if(what == 23){
+      // a batch through the system call ring, then a second
+      // one to close what the first opened.
+      struct stat st;
+      struct cqe c;
+      ringpush(r, SYS_write, fd, (uint64)buf, sizeof(buf), 0);
+      ringpush(r, SYS_read, fd, (uint64)buf, sizeof(buf), 0);
+      ringpush(r, SYS_fstat, fd, (uint64)&st, 0, 0);
+      ringpush(r, SYS_open, (uint64)"grindir/../a", O_CREATE|O_RDWR, 0, 1);
+      if(ringsubmit(r) != 4){
+        printf("grind: ringsubmit failed\n");
+        exit(1);
+      }
+      while(ringpop(r, &c) == 0)
+        if(c.data == 1 && c.res >= 0)
+          ringpush(r, SYS_close, c.res, 0, 0, 0);
+      ringsubmit(r);
+      while(ringpop(r, &c) == 0)
+        ;
     }
   }
 }
@@ -8,9 +8,22 @@
 #include "kernel/file.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/procfs.h"
 
 char *argv[] = { "sh", 0 };
 
+struct {
+  char *path;
+  short minor;
+} procfiles[] = {
+  { "/proc/procs", PROC_PROCS },
+  { "/proc/files", PROC_FILES },
+  { "/proc/mem", PROC_MEM },
+  { "/proc/bcache", PROC_BCACHE },
+  { "/proc/log", PROC_LOG },
+  { "/proc/locks", PROC_LOCKS },
+};
+
 int
 main(void)
 {
@@ -20,6 +33,11 @@ main(void)
     mknod("console", CONSOLE, 0);
     open("console", O_RDWR);
   }
+  // these fail if they exist already; that's fine.
+  mknod("statistics", STATS, 0);
+  mkdir("/proc");
+  for(int i = 0; i < sizeof(procfiles)/sizeof(procfiles[0]); i++)
+    mknod(procfiles[i].path, PROCFS, procfiles[i].minor);
   dup(0);  // stdout
   dup(0);  // stderr
 
@@ -3,6 +3,15 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/syscall.h"
+#include "kernel/ring.h"
+
+// directory entries listed per batch. each holds a file
+// descriptor while its batch is in flight.
+#define NBATCH 8
+
+struct ring *ring;
+char paths[NBATCH][512];
 
 char*
 fmtname(char *path)
@@ -23,12 +32,49 @@ fmtname(char *path)
   return buf;
 }
 
+// print the files paths[0..n-1]. each is opened, fstat()ed
+// and closed through the ring, in two trips into the kernel
+// for the lot.
+void
+lsbatch(int n)
+{
+  struct stat st[NBATCH];
+  int ok[NBATCH];
+  struct cqe c;
+  int i;
+
+  for(i = 0; i < n; i++){
+    ok[i] = 0;
+    ringpush(ring, SYS_open, (uint64)paths[i], O_RDONLY, 0, i);
+  }
+  ringsubmit(ring);
+  while(ringpop(ring, &c) == 0){
+    if(c.res < 0)
+      continue;
+    ok[c.data] = 1;
+    ringpush(ring, SYS_fstat, c.res, (uint64)&st[c.data], 0, c.data);
+    ringpush(ring, SYS_close, c.res, 0, 0, NBATCH);
+  }
+  ringsubmit(ring);
+  while(ringpop(ring, &c) == 0)
+    if(c.data < NBATCH && c.res < 0)
+      ok[c.data] = 0;
+
+  for(i = 0; i < n; i++){
+    if(!ok[i]){
+      printf("ls: cannot stat %s\n", paths[i]);
+      continue;
+    }
+    printf("%s %d %d %d\n", fmtname(paths[i]), st[i].type, st[i].ino, (int) st[i].size);
+  }
+}
+
 void
 ls(char *path)
 {
   char buf[512], *p;
-  int fd;
-  struct dirent de;
+  int fd, i, n, m;
+  struct dirent de[NBATCH];
   struct stat st;
 
   if((fd = open(path, O_RDONLY)) < 0){
@@ -56,16 +102,16 @@ ls(char *path)
     strcpy(buf, path);
     p = buf+strlen(buf);
     *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
-      if(stat(buf, &st) < 0){
-        printf("ls: cannot stat %s\n", buf);
-        continue;
+    while((n = read(fd, de, sizeof(de)) / sizeof(de[0])) > 0){
+      m = 0;
+      for(i = 0; i < n; i++){
+        if(de[i].inum == 0)
+          continue;
+        memmove(p, de[i].name, DIRSIZ);
+        p[DIRSIZ] = 0;
+        strcpy(paths[m++], buf);
       }
-      printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, (int) st.size);
+      lsbatch(m);
     }
     break;
   }
@@ -77,6 +123,10 @@ main(int argc, char *argv[])
 {
   int i;
 
+  if((ring = ringalloc(2*NBATCH)) == 0){
+    fprintf(2, "ls: ringalloc failed\n");
+    exit(1);
+  }
   if(argc < 2){
     ls(".");
     exit(0);
@@ -0,0 +1,43 @@
+// nice: run a command with an adjusted scheduling priority.
+//   nice [-n incr] cmd [args...]   -- SCHED_FAIR, nice value + incr
+//   nice -r prio cmd [args...]     -- SCHED_RT at priority prio
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int incr = 10;
+  int rt = 0;
+  int prio = 0;
+  int i = 1;
+
+  if(argc > 2 && strcmp(argv[1], "-n") == 0){
+    incr = (argv[2][0] == '-') ? -atoi(argv[2] + 1) : atoi(argv[2]);
+    i = 3;
+  } else if(argc > 2 && strcmp(argv[1], "-r") == 0){
+    rt = 1;
+    prio = atoi(argv[2]);
+    i = 3;
+  }
+  if(i >= argc){
+    fprintf(2, "usage: nice [-n incr | -r prio] cmd [args...]\n");
+    exit(1);
+  }
+
+  if(rt){
+    if(setpriority(0, SCHED_RT, prio) < 0){
+      fprintf(2, "nice: bad real-time priority %d\n", prio);
+      exit(1);
+    }
+  } else {
+    nice(incr);
+  }
+
+  exec(argv[i], argv + i);
+  fprintf(2, "nice: exec %s failed\n", argv[i]);
+  exit(1);
+}
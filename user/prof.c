@@ -0,0 +1,279 @@
+// prof: sampling profiler.
+//   prof [-f hz] cmd [args...]  -- profile while cmd runs
+//   prof [-f hz] -t ticks       -- profile everything for ticks
+// Prints a flat profile, busiest functions first: samples, share
+// of all samples, and program:function, where kernel samples are
+// looked up in kernel.sym and user samples in <program>.sym.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define NSAMP 256   // samples read at a time
+#define NTAB  32    // programs seen
+#define NTOP  40    // lines printed
+
+struct sym {
+  uint64 addr;
+  char *name;
+  int count;
+};
+
+// the symbols of one program, sorted by address.
+struct symtab {
+  char name[16];
+  int nsym;
+  struct sym *sym;
+  int unknown;      // samples outside any symbol
+};
+
+struct symtab tabs[NTAB];
+int ntab;
+int nsamples;
+struct profsample samp[NSAMP];
+volatile int done;
+
+static uint64
+hex(char **s)
+{
+  uint64 x = 0;
+  char c;
+
+  for(; (c = **s) != 0; (*s)++){
+    if(c >= '0' && c <= '9')
+      x = x*16 + c - '0';
+    else if(c >= 'a' && c <= 'f')
+      x = x*16 + c - 'a' + 10;
+    else
+      break;
+  }
+  return x;
+}
+
+// is s the name of a section or a source file?
+static int
+notfunc(char *s)
+{
+  int n = strlen(s);
+
+  return s[0] == '.' || (n > 2 && s[n-2] == '.' && (s[n-1] == 'c' || s[n-1] == 'S'));
+}
+
+// read name.sym, lines of "address symbol" from objdump -t.
+static void
+loadsyms(struct symtab *t, char *name)
+{
+  char path[32], *buf, *p, *nl;
+  struct stat st;
+  struct sym tmp;
+  int fd, j, n;
+
+  strcpy(path, name);
+  strcpy(path + strlen(path), ".sym");
+  if((fd = open(path, O_RDONLY)) < 0)
+    return;
+  if(fstat(fd, &st) < 0 || (buf = malloc(st.size + 1)) == 0){
+    close(fd);
+    return;
+  }
+  n = read(fd, buf, st.size);
+  close(fd);
+  if(n < 0)
+    n = 0;
+  buf[n] = 0;
+
+  for(p = buf, n = 0; *p; p++)
+    if(*p == '\n')
+      n++;
+  if((t->sym = malloc((n + 1) * sizeof(struct sym))) == 0)
+    return;
+
+  for(p = buf; *p; p = nl + 1){
+    if((nl = strchr(p, '\n')) == 0)
+      break;
+    *nl = 0;
+    tmp.addr = hex(&p);
+    if(*p++ != ' ' || *p == 0 || notfunc(p))
+      continue;
+    tmp.name = p;
+    tmp.count = 0;
+    for(j = t->nsym; j > 0 && t->sym[j-1].addr > tmp.addr; j--)
+      t->sym[j] = t->sym[j-1];
+    t->sym[j] = tmp;
+    t->nsym++;
+  }
+}
+
+static struct symtab*
+findtab(char *name)
+{
+  struct symtab *t;
+
+  for(t = tabs; t < &tabs[ntab]; t++)
+    if(strcmp(t->name, name) == 0)
+      return t;
+  if(ntab == NTAB)
+    return 0;
+  t = &tabs[ntab++];
+  strcpy(t->name, name);
+  loadsyms(t, name);
+  return t;
+}
+
+// count a sample against the last symbol at or below pc.
+static void
+account(struct profsample *s)
+{
+  struct symtab *t;
+  int lo, hi, mid;
+
+  nsamples++;
+  if((t = findtab(s->user ? s->name : "kernel")) == 0)
+    return;
+  lo = 0;
+  hi = t->nsym;
+  while(lo < hi){
+    mid = (lo + hi) / 2;
+    if(t->sym[mid].addr <= s->pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if(lo == 0)
+    t->unknown++;
+  else
+    t->sym[lo-1].count++;
+}
+
+static void
+drain(void)
+{
+  int i, n;
+
+  do {
+    if((n = profread(samp, NSAMP)) < 0){
+      fprintf(2, "prof: profread failed\n");
+      exit(1);
+    }
+    for(i = 0; i < n; i++)
+      account(&samp[i]);
+  } while(n == NSAMP);
+}
+
+static void
+drainer(void *arg)
+{
+  while(!done){
+    drain();
+    sleep(1);
+  }
+}
+
+static void
+line(int count, char *prog, char *fn)
+{
+  printf("%d\t%d%%\t%s:%s\n", count, count * 100 / nsamples, prog, fn);
+}
+
+// print the NTOP busiest symbols, picking the largest
+// remaining count each time.
+static void
+report(int lost)
+{
+  struct symtab *t, *bt;
+  int i, k, best, bi;
+
+  printf("%d samples, %d lost\n", nsamples, lost);
+  if(nsamples == 0)
+    return;
+  for(k = 0; k < NTOP; k++){
+    best = 0;
+    bt = 0;
+    bi = -1;
+    for(t = tabs; t < &tabs[ntab]; t++){
+      if(t->unknown > best){
+        best = t->unknown;
+        bt = t;
+        bi = -1;
+      }
+      for(i = 0; i < t->nsym; i++){
+        if(t->sym[i].count > best){
+          best = t->sym[i].count;
+          bt = t;
+          bi = i;
+        }
+      }
+    }
+    if(bt == 0)
+      break;
+    if(bi < 0){
+      line(best, bt->name, "?");
+      bt->unknown = 0;
+    } else {
+      line(best, bt->name, bt->sym[bi].name);
+      bt->sym[bi].count = 0;
+    }
+  }
+}
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: prof [-f hz] cmd [args...] | prof [-f hz] -t ticks\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int hz = 1000, ticks = 0, i = 1;
+  int pid, tid, lost;
+
+  if(argc > i+1 && strcmp(argv[i], "-f") == 0){
+    hz = atoi(argv[i+1]);
+    i += 2;
+  }
+  if(argc > i+1 && strcmp(argv[i], "-t") == 0){
+    ticks = atoi(argv[i+1]);
+    i += 2;
+  }
+  if((ticks > 0) == (i < argc))
+    usage();
+
+  findtab("kernel");
+  if(profctl(hz) < 0){
+    fprintf(2, "prof: bad rate %d\n", hz);
+    exit(1);
+  }
+
+  if(ticks > 0){
+    for(; ticks > 0; ticks--){
+      sleep(1);
+      drain();
+    }
+  } else {
+    if((pid = fork()) < 0){
+      fprintf(2, "prof: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[i], argv + i);
+      fprintf(2, "prof: exec %s failed\n", argv[i]);
+      exit(1);
+    }
+    if((tid = thread_create(drainer, 0)) < 0){
+      fprintf(2, "prof: thread_create failed\n");
+      exit(1);
+    }
+    wait(0);
+    done = 1;
+    thread_join(tid);
+  }
+
+  lost = profctl(0);
+  drain();
+  report(lost);
+  exit(0);
+}
@@ -0,0 +1,68 @@
+// Batched system calls through a ring; see kernel/ring.h.
+//
+// ringalloc() makes a ring and registers it. ringpush() queues
+// a system call, ringsubmit() has the kernel carry out all that
+// are queued in one trap, and ringpop() takes their results, in
+// the order they were queued.
+
+#include "kernel/types.h"
+#include "kernel/ring.h"
+#include "user/user.h"
+
+// Make a ring of size entries, a power of two, and make it the
+// process's. Returns 0 on failure.
+struct ring*
+ringalloc(int size)
+{
+  struct ring *r;
+
+  if((r = malloc(RINGBYTES(size))) == 0)
+    return 0;
+  memset(r, 0, RINGBYTES(size));
+  r->size = size;
+  if(ringsetup(r, size) < 0){
+    free(r);
+    return 0;
+  }
+  return r;
+}
+
+// Queue system call op with its arguments. data comes back in
+// its completion. Returns 0, or -1 if the ring is full.
+int
+ringpush(struct ring *r, int op, uint64 a0, uint64 a1, uint64 a2, uint64 data)
+{
+  struct sqe *e;
+
+  // room for its completion, too, so ringsubmit() runs them all.
+  if(r->sqtail - r->cqhead >= r->size)
+    return -1;
+  e = &RINGSQ(r)[r->sqtail & (r->size-1)];
+  e->op = op;
+  e->arg[0] = a0;
+  e->arg[1] = a1;
+  e->arg[2] = a2;
+  e->data = data;
+  r->sqtail++;
+  return 0;
+}
+
+// Carry out the queued calls.
+// Returns how many were carried out, or -1.
+int
+ringsubmit(struct ring *r)
+{
+  return ringenter(r->sqtail - r->sqhead);
+}
+
+// Take the oldest completion into *c.
+// Returns 0, or -1 if there is none.
+int
+ringpop(struct ring *r, struct cqe *c)
+{
+  if(r->cqhead == r->cqtail)
+    return -1;
+  *c = RINGCQ(r)[r->cqhead & (r->size-1)];
+  r->cqhead++;
+  return 0;
+}
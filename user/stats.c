@@ -0,0 +1,57 @@
+// stats: print spinlock contention statistics.
+//   stats            -- counts since boot or the last reset
+//   stats -r         -- zero the counts
+//   stats cmd [args] -- zero the counts, run cmd, then print
+// Columns: lock name, acquisitions, acquisitions that had to
+// spin, spin iterations, and the longest hold in cycles.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+static void
+reset(void)
+{
+  int fd;
+
+  if((fd = open("statistics", O_WRONLY)) < 0 || write(fd, "0", 1) != 1){
+    fprintf(2, "stats: cannot reset statistics\n");
+    exit(1);
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char buf[512];
+  int fd, n, pid;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    reset();
+    exit(0);
+  }
+  if(argc > 1){
+    reset();
+    if((pid = fork()) < 0){
+      fprintf(2, "stats: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "stats: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+
+  if((fd = open("statistics", O_RDONLY)) < 0){
+    fprintf(2, "stats: cannot open statistics\n");
+    exit(1);
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    write(1, buf, n);
+  close(fd);
+  exit(0);
+}
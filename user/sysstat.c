@@ -0,0 +1,125 @@
+// sysstat: print system call counts and times.
+//   sysstat            -- the whole system, since boot
+//   sysstat -p pid     -- one process
+//   sysstat cmd [args] -- the whole system, while cmd runs
+// Columns: calls, total, average and longest time in the call
+// in microseconds, busiest first.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/syscall.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+#define US(t) ((t) / (TIMEBASE / 1000000))
+
+static char *names[NSYSCALL] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_check_superpages] "check_superpages",
+[SYS_setpriority] "setpriority",
+[SYS_nice]    "nice",
+[SYS_clock_gettime] "clock_gettime",
+[SYS_nanosleep] "nanosleep",
+[SYS_clone]   "clone",
+[SYS_join]    "join",
+[SYS_futex]   "futex",
+[SYS_shmget]  "shmget",
+[SYS_shmat]   "shmat",
+[SYS_shmdt]   "shmdt",
+[SYS_shmrm]   "shmrm",
+[SYS_mmap]    "mmap",
+[SYS_munmap]  "munmap",
+[SYS_swapstat] "swapstat",
+[SYS_profctl] "profctl",
+[SYS_profread] "profread",
+[SYS_sysstat] "sysstat",
+[SYS_getcounters] "getcounters",
+[SYS_ringsetup] "ringsetup",
+[SYS_ringenter] "ringenter",
+[SYS_poll]    "poll",
+[SYS_fcntl]   "fcntl",
+[SYS_dmesg]   "dmesg",
+[SYS_fastcalls] "fastcalls",
+};
+
+struct sysstat before[NSYSCALL], st[NSYSCALL];
+
+static void
+get(int pid, struct sysstat *s)
+{
+  if(sysstat(pid, s, NSYSCALL) < 0){
+    fprintf(2, "sysstat: no process %d\n", pid);
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, best, pid = 0;
+  uint64 max;
+
+  if(argc == 3 && strcmp(argv[1], "-p") == 0){
+    pid = atoi(argv[2]);
+    get(pid, st);
+  } else if(argc > 1){
+    get(0, before);
+    if((pid = fork()) < 0){
+      fprintf(2, "sysstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "sysstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+    get(0, st);
+    // a longest call isn't a difference; keep the whole-run maximum.
+    for(i = 0; i < NSYSCALL; i++){
+      st[i].count -= before[i].count;
+      st[i].time -= before[i].time;
+    }
+  } else {
+    get(0, st);
+  }
+
+  printf("syscall\tcalls\ttotal\tavg\tmax (us)\n");
+  for(;;){
+    best = -1;
+    max = 0;
+    for(i = 0; i < NSYSCALL; i++){
+      if(st[i].count && (best < 0 || st[i].time > max)){
+        best = i;
+        max = st[i].time;
+      }
+    }
+    if(best < 0)
+      break;
+    printf("%s\t%ld\t%ld\t%ld\t%ld\n", names[best] ? names[best] : "?",
+           st[best].count, US(st[best].time),
+           US(st[best].time / st[best].count), US(st[best].max));
+    st[best].count = 0;
+  }
+  exit(0);
+}
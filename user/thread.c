@@ -0,0 +1,57 @@
+// Threads on top of clone() and join().
+//
+// thread_create() gives each thread a malloc()ed stack, and
+// thread_join() frees it. malloc() is not thread-safe, so
+// create and join threads from one thread only.
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define STACKSIZE 4096
+
+// clone() starts a thread at threadstart() with sp and a0
+// pointing at this, stored at the top of the thread's stack.
+struct threadstart {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static void
+threadstart(void *a)
+{
+  struct threadstart *ts = a;
+
+  ts->fn(ts->arg);
+  exit(0);
+}
+
+// Start a thread running fn(arg). Returns its id, or -1.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  char *stack;
+  struct threadstart *ts;
+  int tid;
+
+  if((stack = malloc(STACKSIZE)) == 0)
+    return -1;
+  ts = (struct threadstart*)(stack + STACKSIZE) - 1;
+  ts->fn = fn;
+  ts->arg = arg;
+  if((tid = clone(threadstart, ts, ts)) < 0)
+    free(stack);
+  return tid;
+}
+
+// Wait for thread tid to return, and free its stack.
+// Returns tid, or -1.
+int
+thread_join(int tid)
+{
+  void *top;
+
+  if(join(tid, &top) < 0)
+    return -1;
+  free((char*)((struct threadstart*)top + 1) - STACKSIZE);
+  return tid;
+}
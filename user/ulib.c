@@ -1,6 +1,11 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/futex.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "kernel/riscv.h"
+#include "kernel/time.h"
 #include "user/user.h"
 
 //
@@ -145,3 +150,119 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Sleep while *addr == val. Returns 0 when woken, or -1
+// if *addr had already changed.
+int
+futex_wait(int *addr, int val)
+{
+  return futex(addr, FUTEX_WAIT, val);
+}
+
+// Wake up to n threads sleeping on addr; returns how many.
+int
+futex_wake(int *addr, int n)
+{
+  return futex(addr, FUTEX_WAKE, n);
+}
+
+// The kernel keeps the pid and the clock's rate in the USYSCALL
+// page, and user code can read the time CSR, so these three
+// needn't trap. The pid is 0 once there are threads, which have
+// pids of their own.
+int
+getpid(void)
+{
+  struct usyscall *u = (struct usyscall*)USYSCALL;
+
+  if(u->pid == 0)
+    return trap_getpid();
+  return u->pid;
+}
+
+int
+uptime(void)
+{
+  struct usyscall *u = (struct usyscall*)USYSCALL;
+
+  return r_time() / u->tickcycles;
+}
+
+int
+clock_gettime(int clk, struct timespec *ts)
+{
+  struct usyscall *u = (struct usyscall*)USYSCALL;
+  uint64 t;
+
+  if(clk != CLOCK_MONOTONIC)
+    return trap_clock_gettime(clk, ts);
+  t = r_time();
+  ts->tv_sec = t / u->timebase;
+  ts->tv_nsec = (t % u->timebase) * (1000000000 / u->timebase);
+  return 0;
+}
+
+// Mutexes: state is 0 when unlocked, 1 when locked, and 2 when
+// locked with possible sleepers. An uncontended lock and unlock
+// never enter the kernel.
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->state, 2);
+  while(c != 0){
+    futex_wait(&m->state, 2);
+    c = __sync_lock_test_and_set(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    __sync_lock_release(&m->state);
+    futex_wake(&m->state, 1);
+  }
+}
+
+// Condition variables: waiters sleep until seq moves on
+// from the value they saw while holding the mutex.
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = c->seq;
+
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, -1);
+}
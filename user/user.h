@@ -1,4 +1,13 @@
 struct stat;
+struct timespec;
+struct swapstat;
+struct profsample;
+struct sysstat;
+struct counters;
+struct ring;
+struct cqe;
+struct pollfd;
+struct klogrec;
 
 // system calls
 int fork(void);
@@ -23,6 +32,30 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int check_superpages(void *addr, int size);
+int setpriority(int, int, int);
+int nice(int);
+int clock_gettime(int, struct timespec*);
+int nanosleep(const struct timespec*);
+int clone(void (*)(void*), void*, void*);
+int join(int, void**);
+int futex(int*, int, int);
+int shmget(int, int);
+void* shmat(int);
+int shmdt(void*);
+int shmrm(int);
+void* mmap(void*, uint64, int, int, int, int);
+int munmap(void*, uint64);
+int swapstat(struct swapstat*);
+int profctl(int);
+int profread(struct profsample*, int);
+int sysstat(int, struct sysstat*, int);
+int getcounters(struct counters*);
+int ringsetup(struct ring*, int);
+int ringenter(int);
+int poll(struct pollfd*, int, int);
+int fcntl(int, int, int);
+int dmesg(struct klogrec*, int);
+int fastcalls(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -38,7 +71,53 @@ void* memset(void*, int, uint);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+int futex_wait(int*, int);
+int futex_wake(int*, int);
+// getpid(), uptime() and clock_gettime() read the USYSCALL
+// page; these always make the system call.
+int trap_getpid(void);
+int trap_uptime(void);
+int trap_clock_gettime(int, struct timespec*);
+
+struct mutex {
+  int state;
+};
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+
+struct cond {
+  int seq;
+};
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
 
 // umalloc.c
 void* malloc(uint);
 void free(void*);
+
+// thread.c
+int thread_create(void (*)(void*), void*);
+int thread_join(int);
+
+// bench.c
+struct bench {
+  char *name;
+  int iters;
+  uint64 cycles;     // this thread's cycles, from getcounters()
+  uint64 instret;    // this thread's instructions retired
+  uint64 time;       // this thread's run time, in time CSR cycles
+  uint64 wall;       // elapsed time CSR cycles
+};
+void benchstart(struct bench*, char*);
+void benchstop(struct bench*, int);
+void benchprint(struct bench*);
+void bench(char*, void (*)(void*), void*, int);
+
+// ring.c
+struct ring* ringalloc(int);
+int ringpush(struct ring*, int, uint64, uint64, uint64, uint64);
+int ringsubmit(struct ring*);
+int ringpop(struct ring*, struct cqe*);
@@ -7,6 +7,16 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/sched.h"
+#include "kernel/time.h"
+#include "kernel/shm.h"
+#include "kernel/elf.h"
+#include "kernel/swap.h"
+#include "kernel/prof.h"
+#include "kernel/sysstat.h"
+#include "kernel/ring.h"
+#include "kernel/poll.h"
+#include "kernel/klog.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -818,6 +828,1212 @@ killstatus(char *s)
   exit(0);
 }
 
+// setpriority() and nice() argument checking, and
+// inheritance of the scheduling class across fork().
+void
+schedclass(char *s)
+{
+  int xst;
+
+  if(setpriority(0, SCHED_FAIR, NICE_MAX+1) != -1 ||
+     setpriority(0, SCHED_RT, 0) != -1 ||
+     setpriority(0, 7, 0) != -1 ||
+     setpriority(-1, SCHED_FAIR, 0) != -1){
+    printf("%s: setpriority accepted bad arguments\n", s);
+    exit(1);
+  }
+  if(nice(5) != 5 || nice(100) != NICE_MAX || nice(-100) != NICE_MIN){
+    printf("%s: nice() did not clamp\n", s);
+    exit(1);
+  }
+  if(setpriority(0, SCHED_RT, RTPRIO_MIN) != 0){
+    printf("%s: setpriority(SCHED_RT) failed\n", s);
+    exit(1);
+  }
+
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // a SCHED_RT child must still be able to go back to SCHED_FAIR.
+    if(setpriority(0, SCHED_FAIR, 0) != 0)
+      exit(1);
+    exit(nice(0) == 0 ? 0 : 1);
+  }
+  wait(&xst);
+  if(xst != 0){
+    printf("%s: child could not change class\n", s);
+    exit(1);
+  }
+  if(setpriority(pid, SCHED_FAIR, 0) != -1){
+    printf("%s: setpriority on reaped child succeeded\n", s);
+    exit(1);
+  }
+  setpriority(0, SCHED_FAIR, 0);
+  exit(0);
+}
+
+// a SCHED_RT sleeper must get the CPU back soon after it
+// wakes, even with every CPU busy running SCHED_FAIR spinners
+// at the heaviest weight.
+#define NRTSPIN (2*NCPU)
+void
+rtlatency(char *s)
+{
+  int pids[NRTSPIN];
+  struct timespec t0, t1, req;
+  uint64 ns0, ns1, late, maxlate = 0;
+
+  for(int i = 0; i < NRTSPIN; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[i] == 0){
+      nice(NICE_MIN);
+      for(;;)
+        ;
+    }
+  }
+  sleep(1);  // let the spinners get going
+
+  if(setpriority(0, SCHED_RT, RTPRIO_MIN) != 0){
+    printf("%s: setpriority(SCHED_RT) failed\n", s);
+    exit(1);
+  }
+  req.tv_sec = 0;
+  req.tv_nsec = 10000000;  // 10ms
+  for(int i = 0; i < 20; i++){
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if(nanosleep(&req) != 0){
+      printf("%s: nanosleep failed\n", s);
+      exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns0 = t0.tv_sec * 1000000000 + t0.tv_nsec;
+    ns1 = t1.tv_sec * 1000000000 + t1.tv_nsec;
+    late = ns1 - ns0 - req.tv_nsec;
+    if(late > maxlate)
+      maxlate = late;
+  }
+  setpriority(0, SCHED_FAIR, 0);
+
+  for(int i = 0; i < NRTSPIN; i++){
+    kill(pids[i]);
+    wait(0);
+  }
+  if(maxlate > 2 * (1000000000 / HZ)){
+    printf("%s: SCHED_RT wakeup ran %ldns late\n", s, maxlate);
+    exit(1);
+  }
+  exit(0);
+}
+
+// clock_gettime() must be monotonic, and nanosleep() must
+// sleep at least as long as asked even when that is far less
+// than a scheduler tick.
+void
+nanosleeptest(char *s)
+{
+  struct timespec t0, t1, req;
+  uint64 ns0, ns1;
+
+  if(clock_gettime(CLOCK_MONOTONIC+1, &t0) != -1){
+    printf("%s: clock_gettime accepted a bad clock\n", s);
+    exit(1);
+  }
+  if(clock_gettime(CLOCK_MONOTONIC, &t0) != 0){
+    printf("%s: clock_gettime failed\n", s);
+    exit(1);
+  }
+  req.tv_sec = 0;
+  req.tv_nsec = 2000000;  // 2ms
+  if(nanosleep(&req) != 0){
+    printf("%s: nanosleep failed\n", s);
+    exit(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ns0 = t0.tv_sec * 1000000000 + t0.tv_nsec;
+  ns1 = t1.tv_sec * 1000000000 + t1.tv_nsec;
+  if(ns1 < ns0 + req.tv_nsec){
+    printf("%s: nanosleep returned after %ldns\n", s, ns1 - ns0);
+    exit(1);
+  }
+  req.tv_nsec = 1000000000;
+  if(nanosleep(&req) != -1){
+    printf("%s: nanosleep accepted tv_nsec >= 1s\n", s);
+    exit(1);
+  }
+  req.tv_sec = -1;
+  req.tv_nsec = 0;
+  if(nanosleep(&req) != -1){
+    printf("%s: nanosleep accepted a negative tv_sec\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+#define NCLONE 4
+static volatile int clonesum[NCLONE];
+static int clonego;
+
+static void
+clonework(void *arg)
+{
+  int i = (int)(uint64)arg;
+
+  // wait for the go signal, then touch memory grown after clone().
+  while(clonego == 0)
+    futex_wait(&clonego, 0);
+  for(int j = 0; j < 1000; j++)
+    clonesum[i]++;
+  *((char*)sbrk(0) - 1) = i;
+}
+
+static void
+clonespin(void *arg)
+{
+  for(;;)
+    ;
+}
+
+// threads share memory and sz, are woken through a futex,
+// and are reaped by join or when their process exits.
+void
+clonetest(char *s)
+{
+  int tids[NCLONE], pid, xstatus;
+
+  for(int i = 0; i < NCLONE; i++){
+    if((tids[i] = thread_create(clonework, (void*)(uint64)i)) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  sbrk(4096);
+  clonego = 1;
+  futex_wake(&clonego, NCLONE);
+  for(int i = 0; i < NCLONE; i++){
+    if(thread_join(tids[i]) != tids[i]){
+      printf("%s: thread_join failed\n", s);
+      exit(1);
+    }
+    if(clonesum[i] != 1000){
+      printf("%s: thread %d counted %d\n", s, i, clonesum[i]);
+      exit(1);
+    }
+  }
+  if(thread_join(getpid()) != -1 || wait(0) != -1){
+    printf("%s: joined a non-thread\n", s);
+    exit(1);
+  }
+
+  // a process exiting with threads still running.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    thread_create(clonespin, 0);
+    thread_create(clonespin, 0);
+    exit(7);
+  }
+  wait(&xstatus);
+  if(xstatus != 7){
+    printf("%s: exit with threads gave %d\n", s, xstatus);
+    exit(1);
+  }
+  exit(0);
+}
+
+#define NMUTEX 3
+static struct mutex mutextest_m;
+static struct cond mutextest_c;
+static int mutextest_n, mutextest_turn;
+
+static void
+mutexwork(void *arg)
+{
+  int me = (int)(uint64)arg;
+
+  for(int i = 0; i < 100; i++){
+    mutex_lock(&mutextest_m);
+    // take turns, so every handoff goes through the condvar.
+    while(mutextest_turn != me)
+      cond_wait(&mutextest_c, &mutextest_m);
+    mutextest_n++;
+    mutextest_turn = (me + 1) % NMUTEX;
+    cond_broadcast(&mutextest_c);
+    mutex_unlock(&mutextest_m);
+  }
+}
+
+// a bss page that nothing touches before mutextest.
+static char futexbss[2*4096];
+
+// threads hand a mutex around in strict rotation
+// with a condition variable.
+void
+mutextest(char *s)
+{
+  int tids[NMUTEX], x = 5;
+  int *fresh = (int*)(((uint64)futexbss + 4095) & ~4095ULL);
+
+  if(futex_wait(&x, 6) != -1 || futex_wake(&x, 1) != 0){
+    printf("%s: futex on an unwatched word misbehaved\n", s);
+    exit(1);
+  }
+  if(futex_wake(fresh, 1) != 0){
+    printf("%s: futex on a page not yet touched failed\n", s);
+    exit(1);
+  }
+  mutex_init(&mutextest_m);
+  cond_init(&mutextest_c);
+  for(int i = 0; i < NMUTEX; i++){
+    if((tids[i] = thread_create(mutexwork, (void*)(uint64)i)) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < NMUTEX; i++)
+    thread_join(tids[i]);
+  if(mutextest_n != NMUTEX*100){
+    printf("%s: count %d, expected %d\n", s, mutextest_n, NMUTEX*100);
+    exit(1);
+  }
+  exit(0);
+}
+
+// a parent and a forked child see each other's writes
+// to a shared segment, and its pages outlive either
+// mapping until removed.
+void
+shmtest(char *s)
+{
+  int id, pid, xstatus;
+  volatile int *m;
+
+  if(shmget(SHM_PRIVATE, 0) != -1 || shmat(NSHM) != (void*)-1){
+    printf("%s: bad shm arguments accepted\n", s);
+    exit(1);
+  }
+  if((id = shmget(SHM_PRIVATE, 2*4096)) < 0){
+    printf("%s: shmget failed\n", s);
+    exit(1);
+  }
+  if((m = shmat(id)) == (void*)-1){
+    printf("%s: shmat failed\n", s);
+    exit(1);
+  }
+  m[0] = 0;
+  m[1024] = 1;
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // inherited attachment.
+    while(m[0] == 0)
+      futex_wait((int*)&m[0], 0);
+    m[1024] = m[0] + 1;
+    exit(0);
+  }
+  m[0] = 42;
+  futex_wake((int*)&m[0], 1);
+  wait(&xstatus);
+  if(xstatus != 0 || m[1024] != 43){
+    printf("%s: child wrote %d\n", s, m[1024]);
+    exit(1);
+  }
+  if(shmdt((void*)m) != 0 || shmdt((void*)m) != -1){
+    printf("%s: shmdt failed\n", s);
+    exit(1);
+  }
+  if((m = shmat(id)) == (void*)-1 || m[1024] != 43){
+    printf("%s: segment lost its contents\n", s);
+    exit(1);
+  }
+  if(shmrm(id) != 0 || shmat(id) != (void*)-1){
+    printf("%s: shmrm failed\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// a mapped file reads like the file, MAP_PRIVATE writes
+// stay private, and MAP_SHARED writes reach the file on
+// munmap. a forked child shares the same pages, and each
+// side sees the other's stores while both are running.
+void
+mmaptest(char *s)
+{
+  char buf[512], *p;
+  int fd, pid, xstatus, tochild[2], toparent[2];
+  int n = 2*4096 + 100;
+
+  unlink("mmapfile");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create mmapfile failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  for(int off = 0; off < n; off += sizeof(buf))
+    write(fd, buf, off + sizeof(buf) > n ? n - off : sizeof(buf));
+
+  if(mmap(0, n, PROT_READ, MAP_SHARED, fd, 1) != (void*)-1){
+    printf("%s: mmap at an unaligned offset succeeded\n", s);
+    exit(1);
+  }
+  p = mmap(0, n, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (void*)-1){
+    printf("%s: mmap private failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < n; i++){
+    if(p[i] != 'a' + (i % sizeof(buf)) % 26){
+      printf("%s: mapped byte %d is %x\n", s, i, p[i]);
+      exit(1);
+    }
+  }
+  if(p[n] != 0){
+    printf("%s: bytes past end of file not zero\n", s);
+    exit(1);
+  }
+  p[0] = 'X';
+  if(munmap(p, n) != 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  p = mmap(0, n, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (void*)-1){
+    printf("%s: mmap shared failed\n", s);
+    exit(1);
+  }
+  if(p[0] != 'a'){
+    printf("%s: private write reached the file\n", s);
+    exit(1);
+  }
+  p[1] = 'Y';
+  // fault the page in before fork, and check each side's store
+  // while the other is still running, so that neither munmap's
+  // write-back nor a later fault from the file can pass this.
+  if(p[4096] != 'a' + (4096 % sizeof(buf)) % 26){
+    printf("%s: mapped byte 4096 is %x\n", s, p[4096]);
+    exit(1);
+  }
+  if(pipe(tochild) < 0 || pipe(toparent) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    p[4096] = 'Z';
+    write(toparent[1], "x", 1);
+    if(read(tochild[0], buf, 1) != 1)
+      exit(1);
+    exit(p[1] != 'Y' || p[4097] != 'W');
+  }
+  if(read(toparent[0], buf, 1) != 1 || p[4096] != 'Z'){
+    printf("%s: child's store not seen by parent\n", s);
+    exit(1);
+  }
+  p[4097] = 'W';
+  write(tochild[1], "x", 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: parent's store not seen by child\n", s);
+    exit(1);
+  }
+  close(tochild[0]);
+  close(tochild[1]);
+  close(toparent[0]);
+  close(toparent[1]);
+  // unmap the first page, then the rest.
+  if(munmap(p, 4096) != 0 || munmap(p + 4096, n - 4096) != 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, 2) != 2 || buf[1] != 'Y'){
+    printf("%s: shared write not written back\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapfile");
+  exit(0);
+}
+
+// read(), write() and a MAP_SHARED mapping all see
+// one copy of a file's data.
+void
+pagecache(char *s)
+{
+  char buf[8], *p;
+  int fd;
+
+  unlink("pcfile");
+  fd = open("pcfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "abcdefgh", 8) != 8){
+    printf("%s: create pcfile failed\n", s);
+    exit(1);
+  }
+  p = mmap(0, 8, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (void*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  if(p[2] != 'c'){
+    printf("%s: mapped %c, not c\n", s, p[2]);
+    exit(1);
+  }
+
+  // write() lands in the mapped page...
+  close(fd);
+  fd = open("pcfile", O_RDWR);
+  write(fd, "XY", 2);
+  if(p[0] != 'X' || p[1] != 'Y'){
+    printf("%s: write not seen through mapping\n", s);
+    exit(1);
+  }
+
+  // ...and a store to the mapping is seen by read() at once.
+  p[7] = 'Z';
+  if(read(fd, buf, 6) != 6 || buf[5] != 'Z'){
+    printf("%s: store not seen by read\n", s);
+    exit(1);
+  }
+  munmap(p, 8);
+  close(fd);
+  unlink("pcfile");
+  exit(0);
+}
+
+// a read-only MAP_SHARED mapping is the page cache's page, so
+// read() into it must fail rather than change the file.
+void
+mmapro(char *s)
+{
+  char buf[8], *p;
+  int fd;
+
+  unlink("mmaprofile");
+  fd = open("mmaprofile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "abcdefgh", 8) != 8){
+    printf("%s: create mmaprofile failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("mmaprofile", O_RDONLY);
+  p = mmap(0, 8, PROT_READ, MAP_SHARED, fd, 0);
+  if(p == (void*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  // fault the page in for reading first.
+  if(p[0] != 'a'){
+    printf("%s: mapped %c, not a\n", s, p[0]);
+    exit(1);
+  }
+  if(read(fd, p + 4, 4) != -1){
+    printf("%s: read() into a read-only mapping succeeded\n", s);
+    exit(1);
+  }
+  munmap(p, 8);
+  close(fd);
+
+  fd = open("mmaprofile", O_RDONLY);
+  if(read(fd, buf, 8) != 8 || memcmp(buf, "abcdefgh", 8) != 0){
+    printf("%s: file changed through a read-only mapping\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmaprofile");
+  exit(0);
+}
+
+static char execreadbuf[3*4096];
+
+// read() the running program into a bss page that exec has
+// not faulted in yet; the fault reads the same file.
+void
+execread(char *s)
+{
+  int fd, n;
+  struct elfhdr *elf = (struct elfhdr*)execreadbuf;
+
+  fd = open("usertests", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open usertests failed\n", s);
+    exit(1);
+  }
+  n = read(fd, execreadbuf, sizeof(execreadbuf));
+  close(fd);
+  if(n != sizeof(execreadbuf) || elf->magic != ELF_MAGIC){
+    printf("%s: read %d bytes of usertests\n", s, n);
+    exit(1);
+  }
+  exit(0);
+}
+
+// read() can't store into the program's text, which is the page
+// cache's page shared by everyone running usertests, nor into
+// the USYSCALL page.
+void
+textwrite(char *s)
+{
+  char before[8], *text = (char*)textwrite;
+  int fd;
+
+  unlink("textfile");
+  fd = open("textfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "XXXXXXXX", 8) != 8){
+    printf("%s: create textfile failed\n", s);
+    exit(1);
+  }
+  memcpy(before, text, sizeof(before));
+  close(fd);
+  fd = open("textfile", O_RDONLY);
+  if(read(fd, text, 8) != -1 || memcmp(before, text, sizeof(before)) != 0){
+    printf("%s: read() wrote the text\n", s);
+    exit(1);
+  }
+  if(read(fd, (char*)USYSCALL, 8) != -1 || getpid() != trap_getpid()){
+    printf("%s: read() wrote the USYSCALL page\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("textfile");
+  exit(0);
+}
+
+// a read() or write() that runs off the end of memory moves
+// the bytes before it, rather than failing outright.
+void
+shortbuf(char *s)
+{
+  char *top = (char*)(((uint64)sbrk(0) + 4095) & ~4095ULL);
+  char *buf = top - 8;
+  int fds[2], fd;
+
+  if(pipe(fds) < 0 || write(fds[1], "hello", 5) != 5){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(read(fds[0], buf, 4*4096) != 5 || memcmp(buf, "hello", 5) != 0){
+    printf("%s: short read of a pipe failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  unlink("shortfile");
+  fd = open("shortfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, 4096) != 8){
+    printf("%s: write past the end of memory didn't stop there\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("shortfile", O_RDONLY);
+  memset(buf, 0, 8);
+  if(read(fd, buf, 4*4096) != 8 || memcmp(buf, "hello", 5) != 0){
+    printf("%s: short read of a file failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("shortfile");
+}
+
+// the statistics device lists each lock name once, and
+// begins a fresh snapshot after reporting end of file.
+char lockstatsbuf[4096];
+
+void
+lockstats(char *s)
+{
+  int fd, i, n, m, found;
+
+  fd = open("/statistics", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open statistics failed\n", s);
+    exit(1);
+  }
+  for(int pass = 0; pass < 2; pass++){
+    n = 0;
+    while((m = read(fd, lockstatsbuf + n, sizeof(lockstatsbuf) - 1 - n)) > 0)
+      n += m;
+    found = 0;
+    for(i = 0; i + 5 <= n; i++)
+      if((i == 0 || lockstatsbuf[i-1] == '\n') && memcmp(lockstatsbuf + i, "kmem ", 5) == 0)
+        found++;
+    if(found != 1){
+      printf("%s: pass %d: kmem listed %d times\n", s, pass, found);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+// the profiler should catch this process spinning in user space.
+struct profsample profbuf[64];
+
+void
+proftest(char *s)
+{
+  int i, n, mine;
+  uint t0;
+
+  if(profctl(-1) >= 0 || profctl(100000) >= 0){
+    printf("%s: profctl accepted a bad rate\n", s);
+    exit(1);
+  }
+  if(profctl(1000) < 0){
+    printf("%s: profctl failed\n", s);
+    exit(1);
+  }
+  t0 = uptime();
+  while(uptime() < t0 + 3)
+    ;
+  profctl(0);
+
+  mine = 0;
+  while((n = profread(profbuf, sizeof(profbuf)/sizeof(profbuf[0]))) > 0)
+    for(i = 0; i < n; i++)
+      if(profbuf[i].pid == getpid() && profbuf[i].user &&
+         strcmp(profbuf[i].name, "usertests") == 0)
+        mine++;
+  if(n < 0 || mine == 0){
+    printf("%s: no user samples of this process\n", s);
+    exit(1);
+  }
+}
+
+// system calls are counted for the caller and the system.
+struct sysstat sysst0[NSYSCALL], sysst1[NSYSCALL];
+
+void
+sysstattest(char *s)
+{
+  int i;
+
+  if(sysstat(getpid(), sysst0, NSYSCALL) != NSYSCALL){
+    printf("%s: sysstat of self failed\n", s);
+    exit(1);
+  }
+  // getpid() reads the USYSCALL page; trap_getpid() enters the kernel.
+  for(i = 0; i < 10; i++)
+    trap_getpid();
+  sysstat(trap_getpid(), sysst1, NSYSCALL);
+  if(sysst1[SYS_getpid].count - sysst0[SYS_getpid].count != 10 + 1){
+    printf("%s: counted %d getpid calls, not 11\n", s,
+           (int)(sysst1[SYS_getpid].count - sysst0[SYS_getpid].count));
+    exit(1);
+  }
+  if(sysst1[SYS_sysstat].count != sysst0[SYS_sysstat].count + 1){
+    printf("%s: sysstat calls not counted\n", s);
+    exit(1);
+  }
+  if(sysstat(0, sysst0, NSYSCALL) != NSYSCALL ||
+     sysst0[SYS_getpid].count < sysst1[SYS_getpid].count){
+    printf("%s: system totals short\n", s);
+    exit(1);
+  }
+  if(sysstat(-1, sysst0, NSYSCALL) != -1 || sysstat(1000000, sysst0, NSYSCALL) != -1){
+    printf("%s: sysstat of a bad pid succeeded\n", s);
+    exit(1);
+  }
+}
+
+// user code can read the cycle, instret and time CSRs, and
+// getcounters() counts this process's share of them.
+void
+counterstest(char *s)
+{
+  struct counters c0, c1;
+  uint64 cy, in, t;
+  volatile int x = 0;
+
+  cy = r_cycle();
+  in = r_instret();
+  t = r_time();
+  if(getcounters(&c0) < 0){
+    printf("%s: getcounters failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 1000000; i++)
+    x++;
+  getcounters(&c1);
+  if(r_cycle() <= cy || r_instret() <= in || r_time() <= t){
+    printf("%s: raw counters didn't advance\n", s);
+    exit(1);
+  }
+  if(c1.instret - c0.instret < 1000000 || c1.cycles <= c0.cycles ||
+     c1.time <= c0.time){
+    printf("%s: process counters didn't advance\n", s);
+    exit(1);
+  }
+}
+
+// read all of a /proc file, first bytes at a time, to check
+// that reads continue at the file offset.
+static int
+readproc(char *path, char *buf, int sz)
+{
+  int fd, n, m;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  n = 0;
+  while(n < sz-1 && (m = read(fd, buf + n, n < 4 ? 1 : sz-1-n)) > 0)
+    n += m;
+  close(fd);
+  buf[n] = 0;
+  return n;
+}
+
+// does some line of buf start with prefix?
+static int
+hasline(char *buf, char *prefix)
+{
+  int n = strlen(prefix);
+
+  for(char *p = buf; *p; p++)
+    if((p == buf || p[-1] == '\n') && memcmp(p, prefix, n) == 0)
+      return 1;
+  return 0;
+}
+
+// write n in decimal at p. returns the length.
+static int
+fmtint(char *p, int n)
+{
+  char tmp[12];
+  int i = 0, len;
+
+  do {
+    tmp[i++] = '0' + n % 10;
+  } while((n /= 10) > 0);
+  for(len = i; i > 0; i--)
+    *p++ = tmp[i-1];
+  return len;
+}
+
+char procbuf[8192];
+
+void
+procfs(char *s)
+{
+  char line[32], *p;
+  int pid = getpid();
+
+  if(readproc("/proc/procs", procbuf, sizeof(procbuf)) <= 0){
+    printf("%s: read /proc/procs failed\n", s);
+    exit(1);
+  }
+  // "pid ppid tgid state name ..." with ppid unknown here.
+  p = line;
+  p += fmtint(p, pid);
+  *p++ = ' ';
+  *p = 0;
+  if(!hasline(procbuf, line) || !hasline(procbuf, "pid ppid tgid")){
+    printf("%s: no line for pid %d in /proc/procs\n", s, pid);
+    exit(1);
+  }
+  if(readproc("/proc/mem", procbuf, sizeof(procbuf)) <= 0 ||
+     !hasline(procbuf, "free ") || !hasline(procbuf, "slab file ")){
+    printf("%s: /proc/mem incomplete\n", s);
+    exit(1);
+  }
+  if(readproc("/proc/files", procbuf, sizeof(procbuf)) <= 0 ||
+     !hasline(procbuf, line)){
+    printf("%s: no files for pid %d in /proc/files\n", s, pid);
+    exit(1);
+  }
+  if(readproc("/proc/log", procbuf, sizeof(procbuf)) <= 0 || !hasline(procbuf, "commits ") ||
+     readproc("/proc/bcache", procbuf, sizeof(procbuf)) <= 0 || !hasline(procbuf, "hits ")){
+    printf("%s: /proc/log or /proc/bcache incomplete\n", s);
+    exit(1);
+  }
+}
+
+// system calls made in batches through the ring complete in
+// order, with the results they would have had one at a time.
+void
+ringtest(char *s)
+{
+  struct ring *r;
+  struct cqe c;
+  char buf[8];
+  int fd;
+
+  if((r = ringalloc(4)) == 0){
+    printf("%s: ringalloc failed\n", s);
+    exit(1);
+  }
+  ringpush(r, SYS_open, (uint64)"ringf", O_CREATE|O_RDWR, 0, 1);
+  ringpush(r, SYS_fork, 0, 0, 0, 2);
+  if(ringsubmit(r) != 2 || ringpop(r, &c) < 0 || c.data != 1 || (fd = c.res) < 0){
+    printf("%s: ring open failed\n", s);
+    exit(1);
+  }
+  if(ringpop(r, &c) < 0 || c.data != 2 || c.res != -1){
+    printf("%s: ring allowed fork\n", s);
+    exit(1);
+  }
+
+  ringpush(r, SYS_write, fd, (uint64)"ringtest", 8, 3);
+  ringpush(r, SYS_close, fd, 0, 0, 4);
+  ringpush(r, SYS_open, (uint64)"ringf", O_RDONLY, 0, 5);
+  ringpush(r, SYS_close, 99, 0, 0, 6);
+  if(ringpush(r, SYS_close, fd, 0, 0, 7) != -1){
+    printf("%s: ring overfilled\n", s);
+    exit(1);
+  }
+  if(ringsubmit(r) != 4){
+    printf("%s: ringsubmit failed\n", s);
+    exit(1);
+  }
+  for(int i = 3; i <= 6; i++){
+    if(ringpop(r, &c) < 0 || c.data != i){
+      printf("%s: ring completions out of order\n", s);
+      exit(1);
+    }
+    if((i == 3 && c.res != 8) || (i == 4 && c.res != 0) || (i == 6 && c.res != -1)){
+      printf("%s: ring call %d returned %d\n", s, i, c.res);
+      exit(1);
+    }
+    if(i == 5)
+      fd = c.res;
+  }
+
+  ringpush(r, SYS_read, fd, (uint64)buf, sizeof(buf), 8);
+  ringpush(r, SYS_close, fd, 0, 0, 9);
+  ringsubmit(r);
+  if(ringpop(r, &c) < 0 || c.res != 8 || memcmp(buf, "ringtest", 8) != 0){
+    printf("%s: ring read failed\n", s);
+    exit(1);
+  }
+  ringpop(r, &c);
+  unlink("ringf");
+  ringsetup(0, 0);
+  if(ringenter(1) != -1){
+    printf("%s: ringenter without a ring\n", s);
+    exit(1);
+  }
+  free(r);
+}
+
+#define RINGTN 64
+static int ringgo;
+
+static void
+ringthread(void *arg)
+{
+  while(ringgo == 0)
+    futex_wait(&ringgo, 0);
+  ringenter(RINGTN);
+}
+
+// threads entering their process's ring at once carry out
+// each entry once between them.
+void
+ringthreads(char *s)
+{
+  struct ring *r;
+  struct cqe c;
+  struct stat st;
+  int tids[NCLONE], fd, i, n;
+  char seen[RINGTN];
+
+  unlink("ringtf");
+  if((fd = open("ringtf", O_CREATE|O_RDWR)) < 0 || (r = ringalloc(RINGTN)) == 0){
+    printf("%s: setup failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < RINGTN; i++)
+    ringpush(r, SYS_write, fd, (uint64)"x", 1, i);
+  for(i = 0; i < NCLONE; i++){
+    if((tids[i] = thread_create(ringthread, 0)) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  ringgo = 1;
+  futex_wake(&ringgo, NCLONE);
+  ringenter(RINGTN);
+  for(i = 0; i < NCLONE; i++)
+    thread_join(tids[i]);
+
+  memset(seen, 0, sizeof(seen));
+  for(n = 0; ringpop(r, &c) == 0; n++){
+    if(c.data >= RINGTN || seen[c.data]++ || c.res != 1){
+      printf("%s: entry %d completed twice or failed\n", s, (int)c.data);
+      exit(1);
+    }
+  }
+  if(n != RINGTN || fstat(fd, &st) < 0 || st.size != RINGTN){
+    printf("%s: %d completions, file size %d\n", s, n, (int)st.size);
+    exit(1);
+  }
+  close(fd);
+  unlink("ringtf");
+  ringsetup(0, 0);
+  free(r);
+}
+
+static volatile int usyscallpid;
+
+static void
+usyscallthread(void *arg)
+{
+  usyscallpid = getpid();
+}
+
+// getpid(), uptime() and clock_gettime() read the USYSCALL page
+// instead of trapping, and must agree with the system calls.
+void
+usyscall(char *s)
+{
+  struct timespec t0, t1, t2;
+  int pid, xstatus, tid, u0, u1, u2;
+
+  if(getpid() != trap_getpid()){
+    printf("%s: getpid %d, should be %d\n", s, getpid(), trap_getpid());
+    exit(1);
+  }
+  u0 = trap_uptime();
+  u1 = uptime();
+  u2 = trap_uptime();
+  trap_clock_gettime(CLOCK_MONOTONIC, &t0);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  trap_clock_gettime(CLOCK_MONOTONIC, &t2);
+  if(u1 < u0 || u1 > u2 || t1.tv_sec < t0.tv_sec || t1.tv_sec > t2.tv_sec ||
+     t1.tv_nsec >= 1000000000){
+    printf("%s: clocks disagree with the system calls\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(getpid() != trap_getpid())
+      exit(1);
+    // a thread has a pid of its own.
+    if((tid = thread_create(usyscallthread, 0)) < 0 || thread_join(tid) < 0 ||
+       usyscallpid != tid)
+      exit(2);
+    if(getpid() != trap_getpid())
+      exit(3);
+    // the page is read-only.
+    *(volatile int*)USYSCALL = 0;
+    exit(4);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: child exited with %d\n", s, xstatus);
+    exit(1);
+  }
+}
+
+// poll() waits for the first of several pipes, and a pipe with
+// O_NONBLOCK returns -1 rather than wait.
+void
+polltest(char *s)
+{
+  int a[2], b[2], pid, xstatus;
+  struct pollfd pfd[3];
+  struct timespec t0, t1;
+  char c;
+
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pfd[0].fd = a[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = b[0];
+  pfd[1].events = POLLIN;
+  pfd[2].fd = b[1];
+  pfd[2].events = POLLOUT;
+  if(poll(pfd, 3, 0) != 1 || pfd[0].revents || pfd[1].revents || pfd[2].revents != POLLOUT){
+    printf("%s: poll of empty pipes wrong\n", s);
+    exit(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if(poll(pfd, 2, 50) != 0){
+    printf("%s: poll didn't time out\n", s);
+    exit(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  if((t1.tv_sec - t0.tv_sec) * 1000000000 + t1.tv_nsec - t0.tv_nsec < 50000000){
+    printf("%s: poll timed out early\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(2);
+    write(b[1], "x", 1);
+    exit(0);
+  }
+  if(poll(pfd, 2, -1) != 1 || pfd[0].revents || pfd[1].revents != POLLIN){
+    printf("%s: poll didn't see the write\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+
+  if(fcntl(a[0], F_SETFL, O_NONBLOCK) < 0 || fcntl(a[0], F_GETFL, 0) != (O_RDONLY|O_NONBLOCK)){
+    printf("%s: fcntl failed\n", s);
+    exit(1);
+  }
+  if(read(a[0], &c, 1) != -1){
+    printf("%s: non-blocking read of an empty pipe\n", s);
+    exit(1);
+  }
+  close(a[1]);
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != (POLLIN|POLLHUP) || read(a[0], &c, 1) != 0){
+    printf("%s: closed pipe not at end\n", s);
+    exit(1);
+  }
+  close(a[0]);
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != POLLNVAL){
+    printf("%s: poll of a closed fd\n", s);
+    exit(1);
+  }
+  close(b[0]);
+  close(b[1]);
+}
+
+// the kernel's message about a bad access shows up in the log
+// that dmesg() returns.
+void
+dmesgtest(char *s)
+{
+  static struct klogrec r[NKLOG];
+  char want[16];
+  int pid, n, i, j, found;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *(volatile int*)USYSCALL = 0;
+    exit(0);
+  }
+  wait(0);
+
+  // usertrap() prints "... pid=<pid>".
+  strcpy(want, "pid=");
+  want[4 + fmtint(want + 4, pid)] = 0;
+  if((n = dmesg(r, NKLOG)) <= 0){
+    printf("%s: dmesg returned %d\n", s, n);
+    exit(1);
+  }
+  found = 0;
+  for(i = 0; i < n; i++){
+    if(r[i].n > KLOGTEXT || r[i].cpu >= NCPU || (i > 0 && r[i].seq <= r[i-1].seq)){
+      printf("%s: bad record %d\n", s, i);
+      exit(1);
+    }
+    for(j = 0; j + strlen(want) <= r[i].n; j++)
+      if(memcmp(r[i].text + j, want, strlen(want)) == 0 &&
+         (j + strlen(want) == r[i].n || r[i].text[j + strlen(want)] < '0' ||
+          r[i].text[j + strlen(want)] > '9'))
+        found = 1;
+  }
+  if(!found){
+    printf("%s: no fault message for pid %d in dmesg\n", s, pid);
+    exit(1);
+  }
+}
+
+// make system call num with argument arg, holding values in
+// s1-s11. returns 1 if they changed, else 0.
+static int
+sregscall(int num, int arg)
+{
+  register uint64 a0 asm("a0") = arg;
+  register uint64 a7 asm("a7") = num;
+
+  asm volatile(
+    "li s1, 101\n"
+    "li s2, 102\n"
+    "li s3, 103\n"
+    "li s4, 104\n"
+    "li s5, 105\n"
+    "li s6, 106\n"
+    "li s7, 107\n"
+    "li s8, 108\n"
+    "li s9, 109\n"
+    "li s10, 110\n"
+    "li s11, 111\n"
+    "ecall\n"
+    "li a0, 0\n"
+    "li t0, 101\n" "bne s1, t0, 1f\n"
+    "li t0, 102\n" "bne s2, t0, 1f\n"
+    "li t0, 103\n" "bne s3, t0, 1f\n"
+    "li t0, 104\n" "bne s4, t0, 1f\n"
+    "li t0, 105\n" "bne s5, t0, 1f\n"
+    "li t0, 106\n" "bne s6, t0, 1f\n"
+    "li t0, 107\n" "bne s7, t0, 1f\n"
+    "li t0, 108\n" "bne s8, t0, 1f\n"
+    "li t0, 109\n" "bne s9, t0, 1f\n"
+    "li t0, 110\n" "bne s10, t0, 1f\n"
+    "li t0, 111\n" "bne s11, t0, 1f\n"
+    "j 2f\n"
+    "1: li a0, 1\n"
+    "2:\n"
+    : "+r"(a0), "+r"(a7)
+    :
+    : "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11",
+      "t0", "t1", "t2", "t3", "t4", "t5", "t6",
+      "a1", "a2", "a3", "a4", "a5", "a6", "ra", "memory");
+  return a0;
+}
+
+// system calls on the fast trap path, with interrupts off or
+// sleeping, keep the callee-saved registers, as do those on
+// the full path.
+void
+fastcalltest(char *s)
+{
+  for(int on = 1; on >= 0; on--){
+    fastcalls(on);
+    if(sregscall(SYS_getpid, 0) || sregscall(SYS_sleep, 1) ||
+       sregscall(SYS_fstat, -1)){
+      printf("%s: s registers lost, fastcalls %d\n", s, on);
+      exit(1);
+    }
+    if(trap_getpid() != getpid()){
+      printf("%s: wrong pid, fastcalls %d\n", s, on);
+      exit(1);
+    }
+  }
+  fastcalls(1);
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(char *s)
@@ -1924,9 +3140,10 @@ dirfile(char *s)
 void
 iref(char *s)
 {
+  enum { N = 51 };  // more than the inode table once held
   int i, fd;
 
-  for(i = 0; i < NINODE + 1; i++){
+  for(i = 0; i < N; i++){
     if(mkdir("irefd") != 0){
       printf("%s: mkdir irefd failed\n", s);
       exit(1);
@@ -1948,7 +3165,7 @@ iref(char *s)
   }
 
   // clean up
-  for(i = 0; i < NINODE + 1; i++){
+  for(i = 0; i < N; i++){
     chdir("..");
     unlink("irefd");
   }
@@ -1956,13 +3173,11 @@ iref(char *s)
   chdir("/");
 }
 
-// test that fork fails gracefully
-// the forktest binary also does this, but it runs out of proc entries first.
-// inside the bigger usertests binary, we run out of memory first.
+// test that fork fails gracefully, by running out of memory.
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = 10000 };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -1979,7 +3194,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2610,6 +3825,29 @@ struct test {
   {exectest, "exectest"},
   {pipe1, "pipe1"},
   {killstatus, "killstatus"},
+  {schedclass, "schedclass"},
+  {rtlatency, "rtlatency"},
+  {nanosleeptest, "nanosleep"},
+  {clonetest, "clone"},
+  {mutextest, "mutex"},
+  {shmtest, "shm"},
+  {mmaptest, "mmap"},
+  {pagecache, "pagecache"},
+  {mmapro, "mmapro"},
+  {execread, "execread"},
+  {textwrite, "textwrite"},
+  {shortbuf, "shortbuf"},
+  {lockstats, "lockstats"},
+  {proftest, "prof"},
+  {sysstattest, "sysstat"},
+  {counterstest, "counters"},
+  {procfs, "procfs"},
+  {ringtest, "ring"},
+  {ringthreads, "ringthreads"},
+  {usyscall, "usyscall"},
+  {polltest, "poll"},
+  {dmesgtest, "dmesg"},
+  {fastcalltest, "fastcall"},
   {preempt, "preempt"},
   {exitwait, "exitwait"},
   {reparent, "reparent" },
@@ -2939,6 +4177,62 @@ outofinodes(char *s)
   }
 }
 
+// processes that together touch more memory than the machine
+// has are paged out to swap and in again with their data intact.
+void
+swaptest(char *s)
+{
+  enum { NCHILD = 4, NPAGES = 8000 };
+  struct swapstat st0, st1;
+  int i, j, xstatus, ok;
+  char *p;
+
+  if(swapstat(&st0) < 0){
+    printf("%s: swapstat failed\n", s);
+    exit(1);
+  }
+
+  for(i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      if((p = sbrk(NPAGES * 4096)) == (char*)-1){
+        printf("%s: sbrk failed\n", s);
+        exit(1);
+      }
+      for(j = 0; j < NPAGES; j++)
+        *(int*)(p + j*4096) = i * NPAGES + j;
+      sleep(1);
+      for(j = 0; j < NPAGES; j++){
+        if(*(int*)(p + j*4096) != i * NPAGES + j){
+          printf("%s: child %d page %d lost\n", s, i, j);
+          exit(1);
+        }
+      }
+      exit(0);
+    }
+  }
+
+  ok = 1;
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      ok = 0;
+  }
+  if(!ok)
+    exit(1);
+
+  swapstat(&st1);
+  if(st1.swapouts == st0.swapouts || st1.swapins == st0.swapins){
+    printf("%s: nothing went through swap\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
 struct test slowtests[] = {
   {bigdir, "bigdir"},
   {manywrites, "manywrites"},
@@ -2946,6 +4240,7 @@ struct test slowtests[] = {
   {execout, "execout"},
   {diskfull, "diskfull"},
   {outofinodes, "outofinodes"},
+  {swaptest, "swaptest"},
     
   { 0, 0},
 };
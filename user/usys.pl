@@ -6,10 +6,13 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
 
+# an optional second argument names the stub, for a call
+# that ulib wraps.
 sub entry {
     my $name = shift;
-    print ".global $name\n";
-    print "${name}:\n";
+    my $stub = shift || $name;
+    print ".global $stub\n";
+    print "${stub}:\n";
     print " li a7, SYS_${name}\n";
     print " ecall\n";
     print " ret\n";
@@ -32,7 +35,31 @@ entry("link");
 entry("mkdir");
 entry("chdir");
 entry("dup");
-entry("getpid");
+entry("getpid", "trap_getpid");
 entry("sbrk");
 entry("sleep");
-entry("uptime");
+entry("uptime", "trap_uptime");
+entry("setpriority");
+entry("nice");
+entry("clock_gettime", "trap_clock_gettime");
+entry("nanosleep");
+entry("clone");
+entry("join");
+entry("futex");
+entry("shmget");
+entry("shmat");
+entry("shmdt");
+entry("shmrm");
+entry("mmap");
+entry("munmap");
+entry("swapstat");
+entry("profctl");
+entry("profread");
+entry("sysstat");
+entry("getcounters");
+entry("ringsetup");
+entry("ringenter");
+entry("poll");
+entry("fcntl");
+entry("dmesg");
+entry("fastcalls");